@@ -5,6 +5,7 @@
 // ====------------------------------------------------------====
 
 #include "ADT.h"
+#include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/raw_ostream.h"
 
 #include <map>
@@ -17,111 +18,550 @@ namespace llvm {
 namespace privAnalysis {
 
 
-// capability number to string for ROSA
-const char *CAPString[CAP_TOTALNUM] = {
-    "CapChown",
-    "CapDacOverride",
-    "CapDacReadSearch",
-    "CapFowner",
-    "CapFsetid",
-    "CapKill",
-    "CapSetgid",
-    "CapSetuid",
-    "CapSetpCap",
-    "CapLinuxImmutable",
-    "CapNetBindService",
-    "CapNetBroadcast",
-    "CapNetAdmin",
-    "CapNetRaw",
-    "CapIpcLock",
-    "CapIpcOwner",
-    "CapSysModule",
-    "CapSysRawio",
-    "CapSysChroot",
-    "CapSysPtrace",
-    "CapSysPacct",
-    "CapSysAdmin",
-    "CapSysBoot",
-    "CapSysNice",
-    "CapSysResource",
-    "CapSysTime",
-    "CapSysTtyConfig",
-    "CapMknod",
-    "CapLease",
-    "CapAuditWrite",
-    "CapAuditControl",
-    "CapSetfCap",
-    "CapMacOverride",
-    "CapMacAdmin",
-    "CapSyslog",
-    "CapWakeAlarm",
-    "CapBlockSuspend"
-};
-
-
-// Add to the FuncCAPTable, if Func exists, merge the CAPArray
+// Number of threads for the dataflow solvers
+// 1 runs the sequential worklist solver
+cl::opt<unsigned> SolverThreads("priv-threads",
+                                cl::desc("Number of threads for the privilege "
+                                         "dataflow solvers"),
+                                cl::init(1));
+
+
+// Number all functions and BBs in the module
+// param: M - the module to number
+void ModuleNumbering::numberModule(Module &M)
+{
+    for (Module::iterator FI = M.begin(), FE = M.end(); FI != FE; ++FI) {
+        numberFunction(&*FI);
+    }
+}
+
+
+// Number the function and all its BBs not numbered yet
+// param: F - the function to number
+// return: the ID of the function
+unsigned ModuleNumbering::numberFunction(Function *F)
+{
+    unsigned ID = addFunction(F);
+
+    for (Function::iterator BI = F->begin(), BE = F->end(); BI != BE; ++BI) {
+        numberBasicBlock(&*BI);
+    }
+
+    return ID;
+}
+
+
+// Number the function only if it's not numbered yet
+// param: F - the function to number
+// return: the ID of the function
+unsigned ModuleNumbering::addFunction(Function *F)
+{
+    unsigned ID = getFuncID(F);
+
+    if (ID == INVALID_ID) {
+        ID = Funcs.size();
+        FuncIDs[F] = ID;
+        Funcs.push_back(F);
+    }
+
+    return ID;
+}
+
+
+// Number a single BasicBlock if it's not numbered yet
+// The BB is numbered as segments if there are cuts inside
+// param: B - the BasicBlock to number
+// return: the ID of the BB
+unsigned ModuleNumbering::numberBasicBlock(BasicBlock *B)
+{
+    unsigned ID = getBBID(B);
+
+    if (ID == INVALID_ID) {
+        ID = BBs.size();
+        BBIDs[B] = ID;
+        BBs.push_back(B);
+        SegBegins.push_back(B->getFirstNonPHI());
+
+        // start a new segment on each cut after the first one
+        if (!Cuts.empty()) {
+            for (BasicBlock::iterator II = B->begin(), IE = B->end();
+                 II != IE; ++II) {
+                auto CI = Cuts.find(&*II);
+                if (CI == Cuts.end() || &*II == SegBegins.back()) {
+                    continue;
+                }
+
+                CI->second = BBs.size();
+                BBs.push_back(B);
+                SegBegins.push_back(&*II);
+            }
+        }
+    }
+
+    return ID;
+}
+
+
+// Add a cut to split the BB of I virtually before I
+// Cuts must be added before the BB is numbered
+// param: I - the first instruction of the new segment
+void ModuleNumbering::addCut(Instruction *I)
+{
+    Cuts[I] = INVALID_ID;
+}
+
+
+// Lookup the ID of the segment I is in, by searching backward
+// for the first instruction of the segment
+// param: I - the instruction
+// return: the ID, or INVALID_ID if not numbered
+unsigned ModuleNumbering::getSegmentID(const Instruction *I) const
+{
+    unsigned ID = getBBID(I->getParent());
+
+    if (ID == INVALID_ID || Cuts.empty()) {
+        return ID;
+    }
+
+    for (const Instruction *P = I; P != NULL; P = P->getPrevNode()) {
+        auto CI = Cuts.find(P);
+        if (CI != Cuts.end() && CI->second != INVALID_ID) {
+            return CI->second;
+        }
+    }
+
+    return ID;
+}
+
+
+// Lookup the ID of the last segment of B
+// return: the ID, or INVALID_ID if not numbered
+unsigned ModuleNumbering::getLastSegmentID(const BasicBlock *B) const
+{
+    unsigned ID = getBBID(B);
+
+    if (ID == INVALID_ID) {
+        return ID;
+    }
+
+    while (!isLastSegment(ID)) {
+        ++ID;
+    }
+
+    return ID;
+}
+
+
+// The instruction to insert before at the end of the segment
+// param: ID - the segment ID
+// return: the first instruction of the next segment, or the
+//         terminator for the last segment of the BB
+Instruction *ModuleNumbering::getSegmentEnd(unsigned ID) const
+{
+    if (isLastSegment(ID)) {
+        return BBs[ID]->getTerminator();
+    }
+
+    return SegBegins[ID + 1];
+}
+
+
+// The number of instructions in the segment, counting the PHIs
+// in the first segment of the BB
+// param: ID - the segment ID
+unsigned ModuleNumbering::getSegmentSize(unsigned ID) const
+{
+    if (Cuts.empty()) {
+        return BBs[ID]->size();
+    }
+
+    BasicBlock::const_iterator II = BBs[ID]->begin();
+    if (ID != getBBID(BBs[ID])) {
+        II = BasicBlock::const_iterator(SegBegins[ID]);
+    }
+
+    unsigned Size = 0;
+    for (BasicBlock::const_iterator IE = BBs[ID]->end();
+         II != IE && (isLastSegment(ID) || &*II != SegBegins[ID + 1]); ++II) {
+        ++Size;
+    }
+
+    return Size;
+}
+
+
+// Lookup the ID of a function
+// return: the ID, or INVALID_ID if not numbered
+unsigned ModuleNumbering::getFuncID(const Function *F) const
+{
+    auto I = FuncIDs.find(F);
+    return I == FuncIDs.end() ? INVALID_ID : I->second;
+}
+
+
+// Lookup the ID of a BasicBlock
+// return: the ID, or INVALID_ID if not numbered
+unsigned ModuleNumbering::getBBID(const BasicBlock *B) const
+{
+    auto I = BBIDs.find(B);
+    return I == BBIDs.end() ? INVALID_ID : I->second;
+}
+
+
+// Add to the FuncCAPTable, merge with the existing CAPArray
 // param: CAPTable - ref to the FuncCAPTable
-//        F - the function to add
+//        FuncID - the ID of function to add
 //        CAParray - the array of capability to add to FuncCAPTable
-void AddToFuncCAPTable(FuncCAPTable_t &CAPTable, Function *F, 
+void AddToFuncCAPTable(FuncCAPTable_t &CAPTable, unsigned FuncID, 
                        CAPArray_t CAParray)
 {
-    // If not found in map, add to map
-    if (CAPTable.find(F) == CAPTable.end()) {
-        CAPTable[F] = CAParray;
-    }
-    // else, Union the two arrays
-    else {
-        CAPTable[F] |= CAParray;
+    // grow the table if the function is numbered after it's created
+    if (FuncID >= CAPTable.size()) {
+        CAPTable.resize(FuncID + 1, 0);
     }
+
+    CAPTable[FuncID] |= CAParray;
 }
 
 
-// Add to the BBCAPTable, if BB exists, merge the CAPArray
+// Add to the BBCAPTable, merge with the existing CAPArray
 // param: CAPTable - ref to the BBCAPTable
-//        B - the BasicBlock to add
+//        BBID - the ID of BasicBlock to add
 //        CAParray - the array of capability to add to FuncCAPTable
-void AddToBBCAPTable(BBCAPTable_t &CAPTable, BasicBlock *B, 
+void AddToBBCAPTable(BBCAPTable_t &CAPTable, unsigned BBID, 
                      CAPArray_t CAParray)
 {
-    // If not found in map, add to map
-    if (CAPTable.find(B) == CAPTable.end() ) {
-        CAPTable[B] = CAParray;
-    }
-    // else, Union the two arrays
-    else {
-        CAPTable[B] |= CAParray;
+    // grow the table if the BB is numbered after it's created
+    if (BBID >= CAPTable.size()) {
+        CAPTable.resize(BBID + 1, 0);
     }
+
+    CAPTable[BBID] |= CAParray;
 }
 
 
 // Copy CAPTable keys from src to dest
-// After this operation, dest would have all keys src
-// has, with empty CAPArrays mapping to each keys
+// After this operation, dest would have the same size
+// as src, with empty CAPArrays for each function
 // param: dest - dest CAPTable
 //        src  - src CAPTable
 void CopyTableKeys(FuncCAPTable_t &dest, const FuncCAPTable_t &src)
 {
-    CAPArray_t emptyArray = 0;
+    dest.assign(src.size(), 0);
+}
 
-    for(auto MI = src.begin(), ME = src.end(); MI != ME; ++ MI) {
-  
-        Function *tf = MI->first;
 
-        dest[tf] = emptyArray;
+// Build CSR graph from adjacency list
+// param: Adj - the successors of each node
+void CSRGraph::build(const AdjList_t &Adj)
+{
+    Offsets.assign(1, 0);
+    Targets.clear();
+
+    for (auto NI = Adj.begin(), NE = Adj.end(); NI != NE; ++NI) {
+        Targets.insert(Targets.end(), NI->begin(), NI->end());
+        Offsets.push_back(Targets.size());
+    }
+}
+
+
+// Build the reverse graph of G by counting the in-degrees first
+// param: G - the graph to reverse
+void CSRGraph::buildReverse(const CSRGraph &G)
+{
+    unsigned NumNodes = G.getNumNodes();
+
+    Offsets.assign(NumNodes + 1, 0);
+    Targets.resize(G.Targets.size());
+
+    for (auto TI = G.Targets.begin(), TE = G.Targets.end(); TI != TE; ++TI) {
+        ++Offsets[*TI + 1];
+    }
+    for (unsigned N = 0; N != NumNodes; ++N) {
+        Offsets[N + 1] += Offsets[N];
+    }
+
+    std::vector<unsigned> Pos(Offsets.begin(), Offsets.end() - 1);
+    for (unsigned N = 0; N != NumNodes; ++N) {
+        for (const unsigned *SI = G.succ_begin(N), *SE = G.succ_end(N);
+             SI != SE; ++SI) {
+            Targets[Pos[*SI]++] = N;
+        }
+    }
+}
+
+
+// Remove all calls
+void CallTargetIndex::clear()
+{
+    CallIDs.clear();
+    Calls.clear();
+    Offsets.assign(1, 0);
+    Targets.clear();
+}
+
+
+// Lookup the ID of the call
+// param: I - the call instruction
+// return: the ID, or INVALID_ID if the call is not resolved
+unsigned CallTargetIndex::getCallID(const Instruction *I) const
+{
+    auto CI = CallIDs.find(I);
+    return CI == CallIDs.end() ? INVALID_ID : CI->second;
+}
+
+
+// The callees of the call
+// param: I - the call instruction
+// return: the span of the callees, empty if the call is not resolved
+ArrayRef<Function *> CallTargetIndex::getTargets(const Instruction *I) const
+{
+    unsigned ID = getCallID(I);
+    if (ID == INVALID_ID) { return ArrayRef<Function *>(); }
+
+    return getTargets(ID);
+}
+
+
+// Remove all sets except the empty set
+void CAPSetTable::clear()
+{
+    Sets.assign(1, CAPArray_t(0));
+    IDs.clear();
+    IDs[CAPArray_t(0)] = CAPSET_EMPTY;
+    UnionCache.clear();
+    DiffCache.clear();
+}
+
+
+// Intern the set, append it to the table if it's new
+// param: A - the set to intern
+// return: the ID of the set
+CAPSetID_t CAPSetTable::intern(const CAPArray_t &A)
+{
+    auto Res = IDs.insert(std::make_pair(A, (CAPSetID_t)Sets.size()));
+    if (Res.second) {
+        // The ID has wrapped, fail hard instead of aliasing another set
+        if (Sets.size() >= CAPSET_MAXNUM) {
+            report_fatal_error("Too many unique CAP sets for 16 bit set IDs");
+        }
+        Sets.push_back(A);
+    }
+
+    return Res.first->second;
+}
+
+
+// The union of two sets, memoized by the ID pair
+// param: A, B - the IDs of the sets
+// return: the ID of the union
+CAPSetID_t CAPSetTable::unionSets(CAPSetID_t A, CAPSetID_t B)
+{
+    if (A == B || B == CAPSET_EMPTY) { return A; }
+    if (A == CAPSET_EMPTY) { return B; }
+    if (A > B) { std::swap(A, B); }
+
+    uint32_t Key = (uint32_t)A << 16 | B;
+    auto CI = UnionCache.find(Key);
+    if (CI != UnionCache.end()) { return CI->second; }
+
+    CAPSetID_t ID = intern(Sets[A] | Sets[B]);
+    UnionCache[Key] = ID;
+
+    return ID;
+}
+
+
+// The difference A - B of two sets, memoized by the ID pair
+// param: A - the ID of the set to subtract from
+//        B - the ID of the set to subtract
+// return: the ID of the difference
+CAPSetID_t CAPSetTable::diffSets(CAPSetID_t A, CAPSetID_t B)
+{
+    if (A == B || A == CAPSET_EMPTY) { return CAPSET_EMPTY; }
+    if (B == CAPSET_EMPTY) { return A; }
+
+    uint32_t Key = (uint32_t)A << 16 | B;
+    auto CI = DiffCache.find(Key);
+    if (CI != DiffCache.end()) { return CI->second; }
+
+    CAPSetID_t ID = intern(Sets[A] & ~Sets[B]);
+    DiffCache[Key] = ID;
+
+    return ID;
+}
+
+
+// Find strongly connected components with iterative Tarjan's algorithm
+// SCCs are saved in reverse topological order, so that all successors
+// of an SCC are saved before the SCC itself
+// param: Succs - the successors of each node
+//        SCCs  - the SCCs to save to
+void FindSCCs(const CSRGraph &Succs, std::vector<std::vector<unsigned> > &SCCs)
+{
+    unsigned NumNodes = Succs.getNumNodes();
+    std::vector<unsigned> Index(NumNodes, INVALID_ID);
+    std::vector<unsigned> LowLink(NumNodes, 0);
+    std::vector<bool> OnStack(NumNodes, false);
+    std::vector<unsigned> Stack;
+    unsigned NextIndex = 0;
+
+    // DFS stack of nodes and the position of their next successor
+    std::vector<std::pair<unsigned, unsigned> > DFS;
+
+    for (unsigned Root = 0; Root != NumNodes; ++Root) {
+        if (Index[Root] != INVALID_ID) { continue; }
+
+        Index[Root] = LowLink[Root] = NextIndex++;
+        Stack.push_back(Root);
+        OnStack[Root] = true;
+        DFS.push_back(std::make_pair(Root, 0U));
+
+        while (!DFS.empty()) {
+            unsigned V = DFS.back().first;
+
+            // visit the next successor of V
+            if (Succs.succ_begin(V) + DFS.back().second != Succs.succ_end(V)) {
+                unsigned W = Succs.succ_begin(V)[DFS.back().second++];
+
+                if (Index[W] == INVALID_ID) {
+                    Index[W] = LowLink[W] = NextIndex++;
+                    Stack.push_back(W);
+                    OnStack[W] = true;
+                    DFS.push_back(std::make_pair(W, 0U));
+                }
+                else if (OnStack[W]) {
+                    LowLink[V] = std::min(LowLink[V], Index[W]);
+                }
+                continue;
+            }
+
+            // all successors visited, return to the parent
+            DFS.pop_back();
+            if (!DFS.empty()) {
+                unsigned P = DFS.back().first;
+                LowLink[P] = std::min(LowLink[P], LowLink[V]);
+            }
+
+            // V is the root of an SCC, pop the SCC from stack
+            if (LowLink[V] == Index[V]) {
+                SCCs.push_back(std::vector<unsigned>());
+                unsigned W;
+                do {
+                    W = Stack.back();
+                    Stack.pop_back();
+                    OnStack[W] = false;
+                    SCCs.back().push_back(W);
+                } while (W != V);
+            }
+        }
     }
 }
 
 
+// Collapse regions of identity nodes into the super-node of their
+// only exit, for backward union dataflow problems
+// An identity node has an empty gen set, so its value is the union
+// of its successors. An SCC of identity nodes, including a single
+// node, whose successors out of the SCC are all in one super-node
+// has the same value as that super-node, and joins it. SCCs are
+// visited successors first, so chains and single exit regions of
+// identity nodes collapse into the node they exit to. Each other
+// node is the representative of its own super-node.
+// param: Succs - the successors of each node
+//        IsIdentity - if the gen set of each node is empty
+//        SuperNode - the super-node ID of each node to save to
+//        SuperRep - the representative node of each super-node to save to
+//        SuperSuccs - the successors of each super-node to save to, a
+//                     super-node is its own successor if it's in a cycle
+// return: the number of super-nodes
+unsigned CollapseIdentityNodes(const CSRGraph &Succs,
+                               const std::vector<bool> &IsIdentity,
+                               std::vector<unsigned> &SuperNode,
+                               std::vector<unsigned> &SuperRep,
+                               CSRGraph &SuperSuccs)
+{
+    unsigned NumNodes = Succs.getNumNodes();
+    std::vector<std::vector<unsigned> > SCCs;
+    FindSCCs(Succs, SCCs);
+
+    // The representative each node has the same value as, the nodes of
+    // SCCs not visited yet are INVALID_ID
+    std::vector<unsigned> Rep(NumNodes, INVALID_ID);
+
+    for (auto CI = SCCs.begin(), CE = SCCs.end(); CI != CE; ++CI) {
+        unsigned Exit = INVALID_ID;
+        bool Collapse = true;
+
+        for (auto NI = CI->begin(), NE = CI->end(); Collapse && NI != NE; ++NI) {
+            if (!IsIdentity[*NI]) {
+                Collapse = false;
+                break;
+            }
+
+            for (const unsigned *SI = Succs.succ_begin(*NI),
+                     *SE = Succs.succ_end(*NI); SI != SE; ++SI) {
+                // successors in the same SCC
+                if (Rep[*SI] == INVALID_ID) { continue; }
+
+                if (Exit == INVALID_ID) {
+                    Exit = Rep[*SI];
+                }
+                else if (Exit != Rep[*SI]) {
+                    Collapse = false;
+                    break;
+                }
+            }
+        }
+
+        // SCCs exiting nowhere are kept, their value is the empty set
+        Collapse &= (Exit != INVALID_ID);
+
+        for (auto NI = CI->begin(), NE = CI->end(); NI != NE; ++NI) {
+            Rep[*NI] = Collapse ? Exit : *NI;
+        }
+    }
+
+    // Number the representatives in the order of nodes
+    SuperNode.assign(NumNodes, INVALID_ID);
+    SuperRep.clear();
+    for (unsigned N = 0; N != NumNodes; ++N) {
+        if (Rep[N] != N) { continue; }
+        SuperNode[N] = SuperRep.size();
+        SuperRep.push_back(N);
+    }
+
+    // Only representatives have edges out of their super-node, the
+    // edges of the other nodes are in the super-node
+    AdjList_t Adj(SuperRep.size());
+    for (unsigned N = 0; N != NumNodes; ++N) {
+        SuperNode[N] = SuperNode[Rep[N]];
+        if (Rep[N] != N) { continue; }
+
+        std::vector<unsigned> &SuperSucc = Adj[SuperNode[N]];
+        for (const unsigned *SI = Succs.succ_begin(N),
+                 *SE = Succs.succ_end(N); SI != SE; ++SI) {
+            SuperSucc.push_back(SuperNode[Rep[*SI]]);
+        }
+
+        std::sort(SuperSucc.begin(), SuperSucc.end());
+        SuperSucc.erase(std::unique(SuperSucc.begin(), SuperSucc.end()),
+                        SuperSucc.end());
+    }
+    SuperSuccs.build(Adj);
+
+    return SuperRep.size();
+}
+
+
 // Find the size of the input array
 // param: A - the input array
 // return the number of the capablities inside CAPArray 
 int findCAPArraySize(const CAPArray_t &A)
 {
-    // to be refactored
     int size = 0;
-    for (int i = 0; i < CAP_TOTALNUM; ++i){
-        size += ((uint64_t)1 << i) & A;
+    for (unsigned W = 0; W != CAP_WORDS; ++W) {
+        size += __builtin_popcountll(getCAPWord(A, W));
     }
 
     return size;
@@ -134,10 +574,10 @@ int findCAPArraySize(const CAPArray_t &A)
 // return: ischanged - if the dest's value is changed
 bool UnionCAPArrays(CAPArray_t &dest, const CAPArray_t &src)
 {
-    bool ischanged = false;
+    CAPArray_t result = dest | src;
+    bool ischanged = result != dest;
 
-    ischanged = ~dest & src;
-    dest = dest | src;
+    dest = result;
 
     return ischanged;
 }
@@ -150,9 +590,8 @@ bool UnionCAPArrays(CAPArray_t &dest, const CAPArray_t &src)
 // return: if there is difference between A and B
 bool DiffCAPArrays(CAPArray_t &dest, const CAPArray_t &A, const CAPArray_t &B) 
 {
-    assert( (A | ~B) && "\nBUG in Diff CAPArrays!\n\n");
     dest = A & ~B;
-    return (bool)dest;
+    return !IsCAPArrayEmpty(dest);
 } 
 
 
@@ -168,19 +607,19 @@ void ReverseCAPArray(CAPArray_t &A)
 // return: if it's empty
 bool IsCAPArrayEmpty(const CAPArray_t &A)
 {
-    return A == 0;
+    return A == CAPArray_t(0);
 }
 
 
 // dump CAPArray for debugging purpose
 void dumpCAPArray(raw_ostream &O, const CAPArray_t &A) {
-    if (A == 0) {
+    if (IsCAPArrayEmpty(A)) {
         O << "empty,";
     }
 
     for (int i = 0; i < CAP_TOTALNUM; ++i) {
-        if (A & ((uint64_t)1 << i)) {
-            O << CAPString[i] << ",";
+        if (HasCAP(A, i)) {
+            O << getCAPName(i) << ",";
         }
     }
 
@@ -196,18 +635,21 @@ void dumpCAPArray(const CAPArray_t &A) {
 
 // dump CAPTable for Debugging purpose
 // param: CT - the CAPTable to dump
-void dumpCAPTable(const FuncCAPTable_t &CT)
+//        N  - the numbering of the functions in CT
+void dumpCAPTable(const FuncCAPTable_t &CT, const ModuleNumbering &N)
 {
-    // iterate through captable, a map from func to array
-    for (auto mi = CT.begin(), me = CT.end();
-         mi != me; ++ mi){
+    // iterate through captable, a table from func ID to array
+    for (unsigned ID = 0, E = CT.size(); ID != E; ++ID) {
+        if (IsCAPArrayEmpty(CT[ID])) {
+            continue;
+        }
 
-        errs() << mi->first->getName() << " Privileges:\t";
+        errs() << N.getFunc(ID)->getName() << " Privileges:\t";
 
         // iterate through cap array
         for (int i = 0; i < CAP_TOTALNUM; ++i) {
-            if (mi->second & ((uint64_t)1 << i)) {
-                errs() << CAPString[i] << "\t";
+            if (HasCAP(CT[ID], i)) {
+                errs() << getCAPName(i) << "\t";
             }
         }
         errs() << "\n";
@@ -8,20 +8,34 @@
 #define __ADT_H__
 
 #include "llvm/IR/Module.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Support/CommandLine.h"
 
 #include <linux/capability.h>
+#include <cassert>
 #include <cstdint>
 
 #include <map>
 #include <array>
 #include <unordered_map>
 #include <string>
+#include <vector>
 
 // Constant Definition
 #define TARGET_FUNC  "priv_raise"
 #define PRIVRAISE    "priv_raise"
 #define PRIVLOWER    "priv_lower"
 #define CAP_TOTALNUM (CAP_LAST_CAP + 1)
+#define INVALID_ID   (~0U)
+
+// The number of 64bit words in a CAPArray, enough for all capabilities
+// Define PRIV_CAP_WORDS at build time to reserve more privilege bits
+#ifdef PRIV_CAP_WORDS
+#define CAP_WORDS    PRIV_CAP_WORDS
+#else
+#define CAP_WORDS    ((CAP_TOTALNUM + 63) / 64)
+#endif
 
 namespace llvm {
 namespace privAnalysis {
@@ -29,41 +43,410 @@ namespace privAnalysis {
 
 // type definition
 
-// using 64bit long unsigned to represent all 37 capabilities
-// typedef std::array<bool, CAP_TOTALNUM> CAPArray_t;
-typedef uint64_t CAPArray_t;
+// A set of capabilities in a fixed number of 64bit words, bit i of
+// word w is capability 64 * w + i
+template <unsigned NumWords>
+struct CAPWords
+{
+public:
+    uint64_t Words[NumWords];
+
+    CAPWords(uint64_t Low = 0) : Words{Low} { }
+
+    CAPWords &operator|=(const CAPWords &B)
+    {
+        for (unsigned i = 0; i != NumWords; ++i) { Words[i] |= B.Words[i]; }
+        return *this;
+    }
+
+    CAPWords &operator&=(const CAPWords &B)
+    {
+        for (unsigned i = 0; i != NumWords; ++i) { Words[i] &= B.Words[i]; }
+        return *this;
+    }
+
+    CAPWords operator~() const
+    {
+        CAPWords R;
+        for (unsigned i = 0; i != NumWords; ++i) { R.Words[i] = ~Words[i]; }
+        return R;
+    }
+
+    CAPWords operator|(const CAPWords &B) const { return CAPWords(*this) |= B; }
+    CAPWords operator&(const CAPWords &B) const { return CAPWords(*this) &= B; }
+
+    bool operator==(const CAPWords &B) const
+    {
+        for (unsigned i = 0; i != NumWords; ++i) {
+            if (Words[i] != B.Words[i]) { return false; }
+        }
+        return true;
+    }
+
+    bool operator!=(const CAPWords &B) const { return !(*this == B); }
+
+    // Ordered as integers, from the highest word
+    bool operator<(const CAPWords &B) const
+    {
+        for (unsigned i = NumWords; i-- != 0; ) {
+            if (Words[i] != B.Words[i]) { return Words[i] < B.Words[i]; }
+        }
+        return false;
+    }
+
+    explicit operator bool() const { return *this != CAPWords(); }
+};
+
+// The CAPArray type of a number of words, a single word is a plain
+// integer and stays in one register
+template <unsigned NumWords>
+struct CAPArrayOf { typedef CAPWords<NumWords> type; };
+
+template <>
+struct CAPArrayOf<1> { typedef uint64_t type; };
+
+// using 64bit long unsigned words to represent all capabilities
+typedef CAPArrayOf<CAP_WORDS>::type CAPArray_t;
+
+static_assert(CAP_TOTALNUM <= 64 * CAP_WORDS, "CAP_WORDS is too small");
+static_assert(sizeof(CAPArray_t) == 8 * CAP_WORDS, "CAPArray_t is not packed");
+
+// Access the words of a CAPArray
+inline uint64_t &getCAPWord(uint64_t &A, unsigned W) { return A; }
+inline uint64_t getCAPWord(const uint64_t &A, unsigned W) { return A; }
+
+template <unsigned NumWords>
+inline uint64_t &getCAPWord(CAPWords<NumWords> &A, unsigned W)
+{ return A.Words[W]; }
+
+template <unsigned NumWords>
+inline uint64_t getCAPWord(const CAPWords<NumWords> &A, unsigned W)
+{ return A.Words[W]; }
+
+// If the capability is in the CAPArray
+inline bool HasCAP(const CAPArray_t &A, unsigned CAP)
+{ return (getCAPWord(A, CAP / 64) >> (CAP % 64)) & 1; }
+
+// Add the capability to the CAPArray
+inline void AddCAP(CAPArray_t &A, unsigned CAP)
+{
+    assert(CAP < 64 * CAP_WORDS && "The CAP is out of CAPArray!\n");
+    getCAPWord(A, CAP / 64) |= (uint64_t)1 << (CAP % 64);
+}
+
+// Capability names for ROSA, indexed by capability number
+constexpr const char *CAPNames[] = {
+    "CapChown",
+    "CapDacOverride",
+    "CapDacReadSearch",
+    "CapFowner",
+    "CapFsetid",
+    "CapKill",
+    "CapSetgid",
+    "CapSetuid",
+    "CapSetpCap",
+    "CapLinuxImmutable",
+    "CapNetBindService",
+    "CapNetBroadcast",
+    "CapNetAdmin",
+    "CapNetRaw",
+    "CapIpcLock",
+    "CapIpcOwner",
+    "CapSysModule",
+    "CapSysRawio",
+    "CapSysChroot",
+    "CapSysPtrace",
+    "CapSysPacct",
+    "CapSysAdmin",
+    "CapSysBoot",
+    "CapSysNice",
+    "CapSysResource",
+    "CapSysTime",
+    "CapSysTtyConfig",
+    "CapMknod",
+    "CapLease",
+    "CapAuditWrite",
+    "CapAuditControl",
+    "CapSetfCap",
+    "CapMacOverride",
+    "CapMacAdmin",
+    "CapSyslog",
+    "CapWakeAlarm",
+    "CapBlockSuspend",
+    "CapAuditRead",
+    "CapPerfmon",
+    "CapBpf",
+    "CapCheckpointRestore"
+};
+
+// The name of a capability, for capabilities newer than CAPNames too
+constexpr const char *getCAPName(unsigned CAP)
+{
+    return CAP < sizeof(CAPNames) / sizeof(CAPNames[0]) ? CAPNames[CAP]
+                                                        : "CapUnknown";
+}
+
+// The table from function IDs to CAPArray
+typedef std::vector<CAPArray_t> FuncCAPTable_t;
+
+// The table from basicblock IDs to CAPArray
+typedef std::vector<CAPArray_t> BBCAPTable_t;
+
+// The table from basicblock IDs to functions called in the BB
+typedef std::vector<Function*> BBFuncTable_t;
+
+// The list of (BB ID, callee function ID) of calls inside BBs
+typedef std::vector<std::pair<unsigned, unsigned> > BBCallList_t;
+
+// The adjacency list of a graph over dense IDs
+typedef std::vector<std::vector<unsigned> > AdjList_t;
+
+// A graph over dense IDs in compressed sparse row form.
+// Successors of node N are Targets[Offsets[N]] to Targets[Offsets[N+1]]
+struct CSRGraph
+{
+public:
+    std::vector<unsigned> Offsets;
+    std::vector<unsigned> Targets;
+
+    // Build from adjacency list
+    void build(const AdjList_t &Adj);
+
+    // Build the reverse graph of G
+    void buildReverse(const CSRGraph &G);
+
+    unsigned getNumNodes() const
+    { return Offsets.empty() ? 0 : Offsets.size() - 1; }
+
+    const unsigned *succ_begin(unsigned N) const
+    { return Targets.data() + Offsets[N]; }
+
+    const unsigned *succ_end(unsigned N) const
+    { return Targets.data() + Offsets[N + 1]; }
+};
+
+// Index of the resolved callees of call instructions. Calls are
+// numbered densely in the order they are added, and the callees of
+// all calls are saved in one flat array, so the callees of a call
+// are a span of the array, like the successors of a CSRGraph.
+struct CallTargetIndex
+{
+public:
+    CallTargetIndex() { clear(); }
+
+    // Remove all calls
+    void clear();
+
+    // Add a call with its callees, each call is only added once
+    // return: the ID of the call
+    template <typename IterTy>
+    unsigned addCall(const Instruction *I, IterTy Begin, IterTy End)
+    {
+        assert(CallIDs.find(I) == CallIDs.end() && "The call is added twice!\n");
+
+        unsigned ID = Calls.size();
+        CallIDs[I] = ID;
+        Calls.push_back(I);
+        for (; Begin != End; ++Begin) {
+            Targets.push_back(const_cast<Function *>(*Begin));
+        }
+        Offsets.push_back(Targets.size());
 
-// The map from functions to CAPArray
-typedef std::unordered_map<Function*, CAPArray_t> FuncCAPTable_t;
+        return ID;
+    }
 
-// The map from functions to CAPArray
-typedef std::unordered_map<Function*, CAPArray_t> FuncCAPTable_t;
+    // Lookup the ID of the call, INVALID_ID if it's not resolved
+    unsigned getCallID(const Instruction *I) const;
 
-// The map from basicblocks to CAPArray
-typedef std::unordered_map<BasicBlock*, CAPArray_t> BBCAPTable_t;
+    const Instruction *getCall(unsigned ID) const { return Calls[ID]; }
 
-// The map from basicblocks to functions
-typedef std::unordered_map<BasicBlock*, Function*> BBFuncTable_t;
+    // The callees of the call, empty if the call is not resolved
+    ArrayRef<Function *> getTargets(const Instruction *I) const;
 
-// The unique capabiltiy set for all basic blocks mapped to the number of its CAPs
-typedef std::map<CAPArray_t, int> CAPSet_t;
+    ArrayRef<Function *> getTargets(unsigned ID) const
+    {
+        return ArrayRef<Function *>(Targets.data() + Offsets[ID],
+                                    Targets.data() + Offsets[ID + 1]);
+    }
+
+    unsigned getNumCalls() const { return Calls.size(); }
+
+private:
+    DenseMap<const Instruction *, unsigned> CallIDs;
+    std::vector<const Instruction *> Calls;
+    std::vector<unsigned> Offsets;
+    std::vector<Function *> Targets;
+};
+
+// The ID of a capability set interned in a CAPSetTable
+typedef uint16_t CAPSetID_t;
+
+// The ID of the empty set in every CAPSetTable
+#define CAPSET_EMPTY   0
+// The limit of the number of sets, so that ID pairs are not the
+// empty key of DenseMap
+#define CAPSET_MAXNUM  0xFFFF
+
+// The table from basicblock IDs to interned CAPArray IDs
+typedef std::vector<CAPSetID_t> BBCAPSetTable_t;
+
+// Hash of CAPArrays over all words
+struct CAPArrayHash
+{
+    size_t operator()(const CAPArray_t &A) const
+    {
+        uint64_t H = 0;
+        for (unsigned W = 0; W != CAP_WORDS; ++W) {
+            H = (H ^ getCAPWord(A, W)) * 0x9E3779B97F4A7C15ULL;
+        }
+        return H ^ (H >> 32);
+    }
+};
+
+// Hash-consed table of unique capability sets. Each set is saved
+// once and named by a 16bit ID, the empty set is CAPSET_EMPTY.
+// Unions and differences of IDs are memoized by the ID pair, so
+// the sets are only combined once for each pair.
+struct CAPSetTable
+{
+public:
+    CAPSetTable() { clear(); }
+
+    // Remove all sets except the empty set
+    void clear();
+
+    // Intern the set
+    // return: the ID of the set
+    CAPSetID_t intern(const CAPArray_t &A);
+
+    // The set of the ID
+    const CAPArray_t &getSet(CAPSetID_t ID) const { return Sets[ID]; }
+
+    // The union of two sets, memoized
+    CAPSetID_t unionSets(CAPSetID_t A, CAPSetID_t B);
+
+    // The difference A - B of two sets, memoized
+    CAPSetID_t diffSets(CAPSetID_t A, CAPSetID_t B);
+
+    // All unique sets, indexed by IDs
+    const std::vector<CAPArray_t> &getSets() const { return Sets; }
+
+    unsigned getNumSets() const { return Sets.size(); }
+
+private:
+    std::vector<CAPArray_t> Sets;
+    std::unordered_map<CAPArray_t, CAPSetID_t, CAPArrayHash> IDs;
+
+    // Results keyed by the ID pair (A << 16 | B)
+    DenseMap<uint32_t, CAPSetID_t> UnionCache;
+    DenseMap<uint32_t, CAPSetID_t> DiffCache;
+};
+
+// Dense module-wide numbering of Functions and BasicBlocks.
+// All CAP tables are flat arrays indexed by these IDs. BBs created
+// after the module is numbered (e.g. by transformations) are
+// appended to the end, and existing IDs stay valid.
+//
+// A "BB ID" is the ID of a segment of instructions in a BB. A BB is
+// one segment, unless cuts are added before numbering, then the BB
+// is split virtually into segments at the cuts without changing the
+// IR. Segments of a BB have consecutive IDs, and the BB ID of the BB
+// is the ID of its first segment.
+struct ModuleNumbering
+{
+public:
+    // Add a cut to split the BB of I virtually before I
+    void addCut(Instruction *I);
+
+    // Number all functions and BBs in the module
+    void numberModule(Module &M);
+
+    // Number the function and all its BBs not numbered yet
+    // return: the ID of the function
+    unsigned numberFunction(Function *F);
+
+    // Number the function only if it's not numbered yet, its BBs
+    // are numbered later by numberFunction
+    // return: the ID of the function
+    unsigned addFunction(Function *F);
+
+    // Number a single BasicBlock if it's not numbered yet
+    // return: the ID of the BB
+    unsigned numberBasicBlock(BasicBlock *B);
+
+    // Lookup IDs, return INVALID_ID if not numbered
+    unsigned getFuncID(const Function *F) const;
+    unsigned getBBID(const BasicBlock *B) const;
+
+    // Lookup the ID of the segment I is in
+    unsigned getSegmentID(const Instruction *I) const;
+
+    // Lookup the ID of the last segment of B
+    unsigned getLastSegmentID(const BasicBlock *B) const;
+
+    Function *getFunc(unsigned ID) const { return Funcs[ID]; }
+    BasicBlock *getBB(unsigned ID) const { return BBs[ID]; }
+
+    // The first non-PHI instruction of the segment
+    Instruction *getSegmentBegin(unsigned ID) const { return SegBegins[ID]; }
+
+    // The instruction to insert before at the end of the segment,
+    // the terminator of the BB for the last segment
+    Instruction *getSegmentEnd(unsigned ID) const;
+
+    // The number of instructions in the segment
+    unsigned getSegmentSize(unsigned ID) const;
+
+    // If the segment is the last of its BB
+    bool isLastSegment(unsigned ID) const
+    { return ID + 1 == BBs.size() || BBs[ID + 1] != BBs[ID]; }
+
+    unsigned getNumFuncs() const { return Funcs.size(); }
+    unsigned getNumBBs() const { return BBs.size(); }
+
+private:
+    std::vector<Function *> Funcs;
+    std::vector<BasicBlock *> BBs;
+    std::vector<Instruction *> SegBegins;
+    DenseMap<const Function *, unsigned> FuncIDs;
+    DenseMap<const BasicBlock *, unsigned> BBIDs;
+
+    // Segment IDs of the cuts, INVALID_ID before numbering
+    DenseMap<const Instruction *, unsigned> Cuts;
+};
+
+// Number of threads for the dataflow solvers, from command line
+extern cl::opt<unsigned> SolverThreads;
 
 // --------------------------- //
 // Data manipulation functions
 // --------------------------- //
 // Get the function where the CallInst is in, 
-// add to map from Function to CAPArray
+// add to table from Function ID to CAPArray
 void AddToFuncCAPTable(FuncCAPTable_t &CAPTable, 
-                       Function *F, CAPArray_t CAParray);
+                       unsigned FuncID, CAPArray_t CAParray);
 
 // Get the BasicBlock where the CallInst is in
-// add to map from BasicBlock to CAPArray
+// add to table from BasicBlock ID to CAPArray
 void AddToBBCAPTable(BBCAPTable_t &CAPTable, 
-                     BasicBlock *B, CAPArray_t CAParray);
+                     unsigned BBID, CAPArray_t CAParray);
 
-// Copy CAPTable keys from src to dest, with array empty
+// Copy CAPTable size from src to dest, with array empty
 void CopyTableKeys(FuncCAPTable_t &dest, const FuncCAPTable_t &src);
 
+// Find strongly connected components of a graph over dense IDs
+// SCCs are saved in reverse topological order, successors first
+void FindSCCs(const CSRGraph &Succs, std::vector<std::vector<unsigned> > &SCCs);
+
+// Collapse regions of identity nodes into the super-node of their
+// only exit, for backward union dataflow problems
+// return: the number of super-nodes
+unsigned CollapseIdentityNodes(const CSRGraph &Succs,
+                               const std::vector<bool> &IsIdentity,
+                               std::vector<unsigned> &SuperNode,
+                               std::vector<unsigned> &SuperRep,
+                               CSRGraph &SuperSuccs);
+
 // ------------------- //
 // Array manipulations
 // ------------------- //
@@ -90,7 +473,8 @@ void dumpCAPArray(const CAPArray_t &A);
 
 // dump CAPTable for Debugging purpose
 // param: CT - the CAPTable to dump
-void dumpCAPTable(const FuncCAPTable_t &CT);
+//        N  - the numbering of the functions in CT
+void dumpCAPTable(const FuncCAPTable_t &CT, const ModuleNumbering &N);
 
 } // namespace privAnalysis
 } // namepsace llvm
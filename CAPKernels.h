@@ -0,0 +1,47 @@
+// ====-------------------  CAPKernels.h --------*- C++ -*---====
+//
+// Bulk operations over packed CAPArrays: gathered union and
+// popcount of tables indexed by IDs.
+//
+// ====-------------------------------------------------------====
+
+#ifndef __CAPKERNELS_H__
+#define __CAPKERNELS_H__
+
+#include "ADT.h"
+
+namespace llvm {
+namespace privAnalysis {
+
+// Union Table[I] for all IDs I in [Begin, End) into Dest
+// param: Dest - the CAPArray to union into
+//        Table - the table indexed by IDs
+//        Begin, End - the range of IDs
+// return: if Dest is changed
+inline bool GatherUnionCAPArrays(CAPArray_t &Dest, const CAPArray_t *Table,
+                                 const unsigned *Begin, const unsigned *End)
+{
+    CAPArray_t V = 0;
+    for (const unsigned *I = Begin; I != End; ++I) {
+        V |= Table[*I];
+    }
+
+    return UnionCAPArrays(Dest, V);
+}
+
+
+// Find the number of CAPs of each CAPArray in a table
+// param: Counts - the counts to save to
+//        A - the table
+//        N - the size of the table
+inline void PopcountCAPTable(unsigned *Counts, const CAPArray_t *A, unsigned N)
+{
+    for (unsigned i = 0; i != N; ++i) {
+        Counts[i] = findCAPArraySize(A[i]);
+    }
+}
+
+} // namespace privAnalysis
+} // namespace llvm
+
+#endif
@@ -2,27 +2,161 @@
 //
 // Find information about call sites from DSA analysis
 //
-// callsToExternNode: mapping from all callsites to externNode
 // callgraphMap:      mapping from caller to callees. All callers
 //                    here have calls to externNodes but are
 //                    complete in DSA analysis
-// instFunMap:        mapping from callsite instruction to 
+// callTargetIndex:   index from callsite instruction to 
 //                    callees. Saved for CFG in Global Live
 //                    Analysis. 
+//
+// With -priv-dsa-cache, the resolved callees are saved to a binary
+// file keyed by the MD5 of the module bitcode, and later runs on the same
+// module map the file instead of running DSA.
 // ====------------------------------------------------------====
 
 
+#include "llvm/Bitcode/ReaderWriter.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+
 #include "DSAExternAnalysis.h"
+#include "SplitBB.h"
+#include "TypeCallResolver.h"
 #include "dsa/DataStructure.h"
 #include "dsa/DSGraph.h"
 #include "dsa/CallTargets.h"
 
+#include <cstddef>
+#include <cstring>
+
 
 using namespace llvm;
 using namespace dsa;
 using namespace privAnalysis;
 using namespace localAnalysis;
 using namespace dsaexterntarget;
+using namespace splitBB;
+
+
+// Tiers of indirect call resolution
+enum CallResolverTier_t {
+    RESOLVER_DSA,
+    RESOLVER_POINTSTO,
+    RESOLVER_TYPE
+};
+
+static cl::opt<CallResolverTier_t> CallResolverTier("priv-call-resolver",
+    cl::desc("Resolver of indirect call targets"),
+    cl::values(clEnumValN(RESOLVER_DSA, "dsa",
+                          "Top-down DSA (precise, slow)"),
+               clEnumValN(RESOLVER_POINTSTO, "points-to",
+                          "Flow-insensitive points-to (fast)"),
+               clEnumValN(RESOLVER_TYPE, "type",
+                          "No resolution, all indirect calls are incomplete"),
+               clEnumValEnd),
+    cl::init(RESOLVER_DSA));
+
+static cl::opt<std::string> DSACacheFile("priv-dsa-cache",
+    cl::desc("Cache file of the resolved indirect call targets"),
+    cl::value_desc("filename"), cl::init(""));
+
+
+// The cache file is the header, followed by uint32_t arrays of
+// Complete[NumCallSites], Offsets[NumCallSites + 1] and
+// Targets[NumTargets]. The callsites are in the order walked by
+// findAllCallSites, and the targets are function IDs.
+#define DSA_CACHE_MAGIC    "PRIVDSA"
+#define DSA_CACHE_VERSION  3
+
+namespace llvm {
+namespace dsaexterntarget {
+
+struct DSACacheHeader
+{
+    char Magic[8];
+    uint32_t Version;
+    uint32_t Resolver;
+    // MD5 of the module bitcode
+    uint8_t Hash[16];
+    uint32_t NumCallSites;
+    uint32_t NumTargets;
+};
+
+} // namespace dsaexterntarget
+} // namespace llvm
+
+
+// Stream to update the MD5 with everything written to it,
+// without keeping the written bytes
+class MD5Stream : public raw_ostream
+{
+public:
+    MD5Stream(MD5 &Hash) : Hash(Hash), Pos(0) {}
+    ~MD5Stream() { flush(); }
+
+private:
+    MD5 &Hash;
+    uint64_t Pos;
+
+    virtual void write_impl(const char *Ptr, size_t Size)
+    {
+        Hash.update(ArrayRef<uint8_t>((const uint8_t *)Ptr, Size));
+        Pos += Size;
+    }
+
+    virtual uint64_t current_pos() const { return Pos; }
+};
+
+
+// Make the key of the cache of the module
+// Any change to the module changes its bitcode and so the key.
+// The bitcode is hashed as it is written, as it is much cheaper
+// to write than the module text.
+// param: M - the module
+//        Key - the header to save to
+static void makeCacheKey(Module &M, DSACacheHeader &Key)
+{
+    MD5 Hash;
+    MD5::MD5Result Result;
+    {
+        MD5Stream OS(Hash);
+        WriteBitcodeToFile(&M, OS);
+    }
+    Hash.final(Result);
+
+    memset(&Key, 0, sizeof(Key));
+    memcpy(Key.Magic, DSA_CACHE_MAGIC, sizeof(Key.Magic));
+    Key.Version = DSA_CACHE_VERSION;
+    Key.Resolver = CallResolverTier;
+    for (unsigned i = 0; i < sizeof(Key.Hash); ++i) {
+        Key.Hash[i] = Result[i];
+    }
+}
+
+
+// Check if the callsite is an indirect call to resolve
+// param: CS - the callsite
+static bool isResolvedCallSite(CallSite &CS)
+{
+    // Only call instructions are saved to callTargetIndex
+    if (!CS.isCall()) { return false; }
+
+    // skip strip pointer casts
+    if (dyn_cast<Function>(CS.getCalledValue()->stripPointerCasts())) {
+        // errs() << "strip Pointer casts\n";
+        return false;
+    }
+
+    // skip NULL pointer casts
+    if (isa<ConstantPointerNull>(CS.getCalledValue()->stripPointerCasts())) {
+        return false;
+    }
+
+    return true;
+}
 
 
 DSAExternAnalysis::DSAExternAnalysis() : ModulePass(ID) { } 
@@ -34,7 +168,13 @@ void DSAExternAnalysis::getAnalysisUsage(AnalysisUsage &AU) const
     AU.setPreservesCFG();
 
     // AU.addRequired<LocalAnalysis>();
-    AU.addRequired<CallTargetFinder<TDDataStructures> >();    
+    AU.addRequired<SplitBB>();
+
+    // DSA is only run if it's the resolver, and run on demand
+    // with the cache
+    if (CallResolverTier == RESOLVER_DSA && DSACacheFile.empty()) {
+        AU.addRequired<CallTargetFinder<TDDataStructures> >();    
+    }
 
     AU.setPreservesAll();
 }
@@ -47,112 +187,264 @@ bool DSAExternAnalysis::doInitialization(Module &M)
 }
 
 
-// Find out all indirect callsites, save to callsToExternNode
-void DSAExternAnalysis::findAllCallSites(CallTargetFinder<TDDataStructures> &CTF)
+// Find out all indirect callsites and their resolved callees
+// The indirect callsites are from the summaries of functions. The
+// callees of complete callsites are saved to callTargetIndex and
+// callgraphMap, so nothing points into the resolver afterwards.
+// param: Summary - the summaries of all functions
+//        Resolve - the resolver of the callees of callsites
+void DSAExternAnalysis::findAllCallSites(ModuleSummary_t &Summary,
+                                         const CallResolver_t &Resolve)
 {
-    callsToExternNode = {};
+    std::vector<Function*>incompleteFuns = {};
+    std::vector<Function*>callees;
+    unsigned numCallSites = 0;
+
+    callTargetIndex.clear();
+    callgraphMap = {};
+
+    // Iterate through the indirect callsites of all functions
+    for (auto SI = Summary.begin(), SE = Summary.end(); SI != SE; ++SI) {
+        for (auto CSI = SI->IndirectCalls.begin(),
+                 CSE = SI->IndirectCalls.end(); CSI != CSE; ++CSI) {
+            CallSite &CS = *CSI;
+            if (!isResolvedCallSite(CS)) { continue; }
+
+            Instruction *callInst = CS.getInstruction();
+            Function* caller = callInst->getParent()->getParent();
+            ++numCallSites;
+
+            // if function callsite is incomplete, then skip adding and delete 
+            // them from callgraph
+            if (!Resolve(CS, callees)) {
+                incompleteFuns.push_back(caller);
+                continue;
+            }
+
+            // Adding to the index from callInst to all possible callees
+            callTargetIndex.addCall(callInst, callees.begin(), callees.end());
+
+            // Adding to mapping from callers to callees 
+            std::vector<Function*> &callerCallees = callgraphMap[caller];
+            callerCallees.insert(callerCallees.end(), callees.begin(), callees.end());
+        }
+    }
+
+    // remove all the incomplete functions from the callgraphMap
+    // we still need to assume there are calls from these functions to callsExternNode 
+    for (std::vector<Function*>::iterator FI = incompleteFuns.begin(), 
+             FE = incompleteFuns.end();
+         FI != FE; ++FI) {
+        callgraphMap.erase(*FI);
+    }
 
-    // Iterate through the CallTargetFinder for all callsites
-    for (std::list<CallSite>::iterator CSI = CTF.cs_begin(), CSE = CTF.cs_end();
-         CSI != CSE; ++CSI) {
-        CallSite &CS = *CSI;
+    // DEBUG
+    fprintf(stderr, "Complete ratio is %.2f%%\n", 
+            100*(float)(callTargetIndex.getNumCalls())/(float)(numCallSites));
+}
 
-        // If a direct call, don't bother
-        Function *CF = CS.getCalledFunction();
-        if (CF) { continue; }
 
-        // skip strip pointer casts
-        if (dyn_cast<Function>(CS.getCalledValue()->stripPointerCasts())) {
-            // errs() << "strip Pointer casts\n";
-            continue;
+// Resolve all indirect callsites with DSA
+// param: CTF - the DSA call target finder
+//        Summary - the summaries of all functions
+void DSAExternAnalysis::findDSACallSites(CallTargetFinder<TDDataStructures> &CTF,
+                                         ModuleSummary_t &Summary)
+{
+    findAllCallSites(Summary, [&](CallSite &CS, std::vector<Function*> &callees) {
+        if (!CTF.isComplete(CS)) { return false; }
+
+        callees.clear();
+        for (auto TI = CTF.begin(CS), TE = CTF.end(CS); TI != TE; ++TI) {
+            callees.push_back(const_cast<Function *>(*TI));
         }
+        return true;
+    });
+}
 
-        // skip NULL pointer casts
-        if (isa<ConstantPointerNull>(CS.getCalledValue()->stripPointerCasts())) {
-            continue;
+
+// Resolve all indirect callsites with the type or points-to tier
+// param: M - the module
+//        Summary - the summaries of all functions
+void DSAExternAnalysis::findTypeCallSites(Module &M, ModuleSummary_t &Summary)
+{
+    TypeCallResolver Resolver(CallResolverTier == RESOLVER_POINTSTO);
+
+    findAllCallSites(Summary, [&](CallSite &CS, std::vector<Function*> &callees) {
+        return Resolver.findTargets(CS, callees);
+    });
+}
+
+
+// Load the resolved callees from the cache file
+// The file is memory mapped, and the callsites are walked in the same
+// order as saved. Any mismatch of the key or the size of the file is
+// a miss of the cache.
+// param: Summary - the summaries of all functions
+//        Numbering - the numbering of functions
+//        Key - the key of the module
+// return: if the cache is valid for the module
+bool DSAExternAnalysis::loadCache(ModuleSummary_t &Summary,
+                                  const ModuleNumbering &Numbering,
+                                  const DSACacheHeader &Key)
+{
+    ErrorOr<std::unique_ptr<MemoryBuffer> > Buffer =
+        MemoryBuffer::getFile(DSACacheFile, -1, false);
+    if (!Buffer) { return false; }
+
+    const char *Data = (*Buffer)->getBufferStart();
+    size_t Size = (*Buffer)->getBufferSize();
+    if (Size < sizeof(DSACacheHeader)) { return false; }
+
+    const DSACacheHeader *Header = reinterpret_cast<const DSACacheHeader *>(Data);
+    if (memcmp(Header, &Key, offsetof(DSACacheHeader, NumCallSites)) != 0) {
+        return false;
+    }
+
+    uint64_t NumCallSites = Header->NumCallSites;
+    uint64_t NumTargets = Header->NumTargets;
+    if (Size != sizeof(DSACacheHeader) +
+        sizeof(uint32_t) * (2 * NumCallSites + 1 + NumTargets)) {
+        return false;
+    }
+
+    const uint32_t *Complete = reinterpret_cast<const uint32_t *>(Header + 1);
+    const uint32_t *Offsets = Complete + NumCallSites;
+    const uint32_t *Targets = Offsets + NumCallSites + 1;
+    unsigned NumFuncs = Numbering.getNumFuncs();
+    unsigned CallSiteID = 0;
+    bool Valid = true;
+
+    findAllCallSites(Summary, [&](CallSite &CS, std::vector<Function*> &callees) {
+        if (CallSiteID >= NumCallSites) {
+            Valid = false;
+            return false;
+        }
+
+        unsigned ID = CallSiteID++;
+        if (!Complete[ID]) { return false; }
+
+        if (Offsets[ID] > Offsets[ID + 1] || Offsets[ID + 1] > NumTargets) {
+            Valid = false;
+            return false;
         }
 
-        // Add it to the data structure callsToExternNode
-        // TODO: here it presumes that anything besides direct call is a call to 
-        // TODO: CallsExternNode
-        for (std::vector<const Function*>::iterator FI = CTF.begin(CS), 
-                 FE = CTF.end(CS);
-             FI != FE; ++FI) {
-            Function* F = const_cast<Function*>(*FI);
-            callsToExternNode[&CS].push_back(F);
+        callees.clear();
+        for (uint32_t TI = Offsets[ID], TE = Offsets[ID + 1]; TI != TE; ++TI) {
+            if (Targets[TI] >= NumFuncs) {
+                Valid = false;
+                return false;
+            }
+            callees.push_back(Numbering.getFunc(Targets[TI]));
         }
-    }
+        return true;
+    });
+
+    return Valid && CallSiteID == NumCallSites;
 }
 
 
-// Save information to corresponding data structures
-void DSAExternAnalysis::saveToMappings(CallTargetFinder<TDDataStructures> &CTF)
+// Save the resolved callees to the cache file
+// The file is written to a temporary file first and renamed, so
+// concurrent runs never map a partial file.
+// param: Summary - the summaries of all functions
+//        Numbering - the numbering of functions
+//        Header - the key of the module
+void DSAExternAnalysis::saveCache(const ModuleSummary_t &Summary,
+                                  const ModuleNumbering &Numbering,
+                                  DSACacheHeader Header) const
 {
-    std::vector<Function*>incompleteFuns = {};
-    callgraphMap = {};
-    instFunMap = {};
-
-    // Based on callsites in callsExternNode, save information to corresponding
-    // data structures
-    // Save complete calls to callgraphMap and InstrFunMap
-    // Save incomplete calls to incompleteFuns, so as to remove them 
-    // from callgraphMap later
-    for (CallSiteFunMap_t::iterator FI = callsToExternNode.begin(), 
-             FE = callsToExternNode.end();
-         FI != FE; ++FI) {
-        CallSite* CS = FI->first;
-        CallInst* callInst = dyn_cast<CallInst>(FI->first->getInstruction());
-        Function* caller = callInst->getParent()->getParent();
-        std::vector<Function*>callees = FI->second;
-
-        // if function callsite is incomplete, then skip adding and delete 
-        // them from callgraph
-        if (!CTF.isComplete(*CS)) {
-            incompleteFuns.push_back(caller);
-            continue;
+    std::vector<uint32_t> Complete;
+    std::vector<uint32_t> Offsets(1, 0);
+    std::vector<uint32_t> Targets;
+
+    for (auto SI = Summary.begin(), SE = Summary.end(); SI != SE; ++SI) {
+        for (auto CSI = SI->IndirectCalls.begin(),
+                 CSE = SI->IndirectCalls.end(); CSI != CSE; ++CSI) {
+            CallSite CS = *CSI;
+            if (!isResolvedCallSite(CS)) { continue; }
+
+            unsigned ID = callTargetIndex.getCallID(CS.getInstruction());
+            Complete.push_back(ID != INVALID_ID);
+
+            if (ID != INVALID_ID) {
+                ArrayRef<Function *> callees = callTargetIndex.getTargets(ID);
+                for (auto FI = callees.begin(), FE = callees.end(); FI != FE; ++FI) {
+                    Targets.push_back(Numbering.getFuncID(*FI));
+                }
+            }
+            Offsets.push_back(Targets.size());
         }
+    }
 
-        // Adding to mapping from callInst to all possible callees
-        assert(callInst && "Call Instruction is NULL\n");
-        instFunMap[callInst] = callees;
+    Header.NumCallSites = Complete.size();
+    Header.NumTargets = Targets.size();
 
-        // Adding to mapping from callers to callees 
-        for (std::vector<Function*>::iterator CII = callees.begin(), 
-                 CIE = callees.end();
-             CII != CIE; ++CII) {
-            Function *Fcallee = const_cast<Function*>(*CII);
-            callgraphMap[caller].push_back(Fcallee);
+    std::string TmpFile = DSACacheFile + ".tmp";
+    std::error_code EC;
+    {
+        raw_fd_ostream Out(TmpFile, EC, sys::fs::F_None);
+        if (EC) {
+            errs() << "Cannot write DSA cache " << TmpFile << ": " << EC.message() << "\n";
+            return;
         }
-    }
 
-    // remove all the incomplete functions from the callgraphMap
-    // we still need to assume there are calls from these functions to callsExternNode 
-    for (std::vector<Function*>::iterator FI = incompleteFuns.begin(), 
-             FE = incompleteFuns.end();
-         FI != FE; ++FI) {
-        callgraphMap.erase(*FI);
+        Out.write(reinterpret_cast<const char *>(&Header), sizeof(Header));
+        Out.write(reinterpret_cast<const char *>(Complete.data()),
+                  sizeof(uint32_t) * Complete.size());
+        Out.write(reinterpret_cast<const char *>(Offsets.data()),
+                  sizeof(uint32_t) * Offsets.size());
+        Out.write(reinterpret_cast<const char *>(Targets.data()),
+                  sizeof(uint32_t) * Targets.size());
     }
 
-    // DEBUG
-    fprintf(stderr, "Complete ratio is %.2f%%\n", 
-            100*(float)(callgraphMap.size())/(float)(callsToExternNode.size()));
-
+    EC = sys::fs::rename(TmpFile, DSACacheFile);
+    if (EC) {
+        errs() << "Cannot write DSA cache " << DSACacheFile << ": " << EC.message() << "\n";
+    }
 }
 
 
 // Run on Module method for pass
+// CallTargetFinder is only used here, the pass manager frees it after
+// this pass as the index keeps no references to it
 bool DSAExternAnalysis::runOnModule(Module &M)
 {
-    CallTargetFinder<TDDataStructures> &CTF = 
-        getAnalysis<CallTargetFinder<TDDataStructures> >();
+    SplitBB &SB = getAnalysis<SplitBB>();
+    ModuleSummary_t &Summary = SB.Summary;
+
+    // Find all indirect callsites and their callees
+    if (DSACacheFile.empty()) {
+        if (CallResolverTier == RESOLVER_DSA) {
+            findDSACallSites(getAnalysis<CallTargetFinder<TDDataStructures> >(),
+                             Summary);
+        }
+        else {
+            findTypeCallSites(M, Summary);
+        }
+        return false;
+    }
+
+    DSACacheHeader Key;
+    makeCacheKey(M, Key);
+
+    if (loadCache(Summary, SB.Numbering, Key)) { return false; }
 
-    // Find all callsites that's calling to callsExternNode
-    // Save results to callsToExternNode
-    findAllCallSites(CTF);
+    // DSA is run on demand if the cache misses, and freed with its
+    // pass manager after the callees are saved
+    if (CallResolverTier == RESOLVER_DSA) {
+        legacy::PassManager DSAPasses;
+        CallTargetFinder<TDDataStructures> *CTF = new CallTargetFinder<TDDataStructures>();
+        DSAPasses.add(CTF);
+        DSAPasses.run(M);
+
+        findDSACallSites(*CTF, Summary);
+    }
+    else {
+        findTypeCallSites(M, Summary);
+    }
+
+    saveCache(Summary, SB.Numbering, Key);
 
-    // Save the information from callsExternNode to mappings
-    saveToMappings(CTF);
-    
     return false;
 }
 
@@ -179,20 +471,18 @@ void DSAExternAnalysis::print(raw_ostream &O, const Module *M) const
         }
     }
 
-    // Dumping information from the instFunMap
+    // Dumping information from the callTargetIndex
     O << "\n*****************************************\n"
-      << "* Dumping information from the instFunMap:\n"
+      << "* Dumping information from the callTargetIndex:\n"
       << "*****************************************\n\n";
 
-    for (InstrFunMap_t::const_iterator II = instFunMap.begin(),
-             IE = instFunMap.end(); II != IE; ++II) {
-        Function* ParentFun = II->first->getParent()->getParent();
-        std::vector<Function*>callees = II->second;
+    for (unsigned ID = 0, E = callTargetIndex.getNumCalls(); ID != E; ++ID) {
+        const Function* ParentFun = callTargetIndex.getCall(ID)->getParent()->getParent();
+        ArrayRef<Function *> callees = callTargetIndex.getTargets(ID);
 
         O << ParentFun->getName() << " has instruction calling: \n";
 
-        for (std::vector<Function*>::const_iterator FI = callees.begin(),
-                 FE = callees.end(); FI != FE; ++FI) {
+        for (auto FI = callees.begin(), FE = callees.end(); FI != FE; ++FI) {
             O << "\t" << (*FI)->getName() << "\n";
         }
     }
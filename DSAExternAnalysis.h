@@ -2,11 +2,13 @@
 //
 // Find information about call sites from DSA analysis
 //
-// callsToExternNode will contain calls to calls external node
+// callTargetIndex will contain calls to calls external node
 // in the LLVM callgraph, which is complete in DSA
 //
 // ====-------------------------------------------------------====
 
+#ifndef __DSAEXTERNANALYSIS_H__
+#define __DSAEXTERNANALYSIS_H__
 
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Function.h"
@@ -14,10 +16,12 @@
 #include "llvm/Analysis/CallGraph.h"
 
 #include "LocalAnalysis.h"
+#include "ModuleSummary.h"
 #include "dsa/DataStructure.h"
 #include "dsa/DSGraph.h"
 #include "dsa/CallTargets.h"
 
+#include <functional>
 #include <vector>
 
 
@@ -26,9 +30,10 @@ namespace dsaexterntarget {
 
 using namespace dsa;
 
-typedef std::unordered_map<CallSite*, std::vector<Function*> > CallSiteFunMap_t;
 typedef std::unordered_map<Function*, std::vector<Function*> > FunctionMap_t;
-typedef std::unordered_map<Instruction*, std::vector<Function*> > InstrFunMap_t;
+
+// Header of the cache file of resolved callees
+struct DSACacheHeader;
 
 struct DSAExternAnalysis : public ModulePass
 {
@@ -37,16 +42,13 @@ public:
 
     DSAExternAnalysis();
 
-    // If a callsite to callsExternNode is complete, record it here
-    // with all its callees
-    CallSiteFunMap_t callsToExternNode;
-    
     // FunctionMap records additional info for the callgraph, mapping callers to
     // callees
     FunctionMap_t callgraphMap;
 
-    // instFunMap records instruction to its possible called functions
-    InstrFunMap_t instFunMap;
+    // callTargetIndex records call instructions complete in DSA
+    // to their possible called functions
+    CallTargetIndex callTargetIndex;
     
     void getAnalysisUsage(AnalysisUsage &AU) const;
 
@@ -57,13 +59,32 @@ public:
     void print(raw_ostream &O, const Module *M) const;
 
 private:
-    // Find out all indirect callsites, save to callsToExternNode
-    void findAllCallSites(CallTargetFinder<TDDataStructures> &CTF);
+    // Resolve the callees of a callsite
+    // return: if the callees are complete
+    typedef std::function<bool(CallSite &, std::vector<Function*> &)> CallResolver_t;
+
+    // Find out all indirect callsites and their resolved callees
+    void findAllCallSites(ModuleSummary_t &Summary, const CallResolver_t &Resolve);
+
+    // Resolve all indirect callsites with DSA
+    void findDSACallSites(CallTargetFinder<TDDataStructures> &CTF,
+                          ModuleSummary_t &Summary);
 
-    // Save information to corresponding data structures
-    void saveToMappings(CallTargetFinder<TDDataStructures> &CTF);
+    // Resolve all indirect callsites with the type or points-to tier
+    void findTypeCallSites(Module &M, ModuleSummary_t &Summary);
+
+    // Load the resolved callees from the cache file
+    // return: if the cache is valid for the module
+    bool loadCache(ModuleSummary_t &Summary, const ModuleNumbering &Numbering,
+                   const DSACacheHeader &Key);
+
+    // Save the resolved callees to the cache file
+    void saveCache(const ModuleSummary_t &Summary, const ModuleNumbering &Numbering,
+                   DSACacheHeader Header) const;
 };
 
 
 } // namespace
 } // namespace
+
+#endif
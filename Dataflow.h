@@ -0,0 +1,283 @@
+// ====-------------------  Dataflow.h ----------*- C++ -*---====
+//
+// Worklist solver for bitvector dataflow problems on CSR graphs.
+// The solver only touches the packed CAPArray and ID arrays, the
+// graphs are built once from the IR before solving.
+//
+// ====-------------------------------------------------------====
+
+#ifndef __DATAFLOW_H__
+#define __DATAFLOW_H__
+
+#include "ADT.h"
+#include "CAPKernels.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <queue>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace llvm {
+namespace privAnalysis {
+
+// Direction of the dataflow problem
+enum DataflowDir_t {
+    DATAFLOW_FORWARD,
+    DATAFLOW_BACKWARD
+};
+
+
+// Solve the union dataflow problem
+//     Value[N] = Gen[N] | Value[M] for all sources M of N
+// Sources are successors for backward problems, and predecessors
+// for forward problems. Every node is visited at least once, in
+// the order of Priority with the highest first. A node is only
+// revisited when one of its sources is changed.
+// param: Succs - the graph
+//        Preds - the reverse graph of Succs
+//        Priority - the priority of each node
+//        Gen - the gen set of each node
+//        Value - the solution, updated in place
+// return: the number of node visits
+template <DataflowDir_t Dir>
+unsigned SolveDataflow(const CSRGraph &Succs, const CSRGraph &Preds,
+                       const std::vector<unsigned> &Priority,
+                       const CAPArray_t *Gen, CAPArray_t *Value)
+{
+    const CSRGraph &Sources = (Dir == DATAFLOW_BACKWARD) ? Succs : Preds;
+    const CSRGraph &Users = (Dir == DATAFLOW_BACKWARD) ? Preds : Succs;
+    unsigned NumNodes = Succs.getNumNodes();
+    unsigned Visits = 0;
+
+    std::vector<bool> InWorklist(NumNodes, true);
+    std::priority_queue<std::pair<unsigned, unsigned> > Worklist;
+
+    for (unsigned N = 0; N != NumNodes; ++N) {
+        Worklist.push(std::make_pair(Priority[N], N));
+    }
+
+    while (!Worklist.empty()) {
+        unsigned N = Worklist.top().second;
+        Worklist.pop();
+        InWorklist[N] = false;
+        ++Visits;
+
+        CAPArray_t V = Gen[N];
+        GatherUnionCAPArrays(V, Value, Sources.succ_begin(N),
+                             Sources.succ_end(N));
+
+        // revisit the users only if the value is changed
+        if (!UnionCAPArrays(Value[N], V)) { continue; }
+
+        for (const unsigned *UI = Users.succ_begin(N),
+                 *UE = Users.succ_end(N); UI != UE; ++UI) {
+            if (!InWorklist[*UI]) {
+                Worklist.push(std::make_pair(Priority[*UI], *UI));
+                InWorklist[*UI] = true;
+            }
+        }
+    }
+
+    return Visits;
+}
+
+
+// Solve the same union dataflow problem in parallel
+// The graph of sources is condensed into SCCs, and each SCC is a
+// task of the thread pool, ready after all SCCs it reads from are
+// solved. The solution is the same least fixpoint as SolveDataflow.
+// param: Succs - the graph
+//        Preds - the reverse graph of Succs
+//        Gen - the gen set of each node
+//        Value - the solution, updated in place
+//        NumThreads - the number of threads
+template <DataflowDir_t Dir>
+void SolveDataflowParallel(const CSRGraph &Succs, const CSRGraph &Preds,
+                           const CAPArray_t *Gen, CAPArray_t *Value,
+                           unsigned NumThreads)
+{
+    const CSRGraph &Sources = (Dir == DATAFLOW_BACKWARD) ? Succs : Preds;
+    unsigned NumNodes = Succs.getNumNodes();
+
+    std::vector<std::vector<unsigned> > SCCs;
+    FindSCCs(Sources, SCCs);
+
+    std::vector<unsigned> SCCOf(NumNodes);
+    for (unsigned i = 0, e = SCCs.size(); i != e; ++i) {
+        for (auto NI = SCCs[i].begin(), NE = SCCs[i].end(); NI != NE; ++NI) {
+            SCCOf[*NI] = i;
+        }
+    }
+
+    // An SCC depends on the SCCs of its sources, and is used by them
+    std::vector<unsigned> NumDeps(SCCs.size(), 0);
+    std::vector<bool> HasCycle(SCCs.size(), false);
+    CSRGraph Users;
+    {
+        AdjList_t SCCUsers(SCCs.size());
+        for (unsigned N = 0; N != NumNodes; ++N) {
+            for (const unsigned *SI = Sources.succ_begin(N),
+                     *SE = Sources.succ_end(N); SI != SE; ++SI) {
+                if (SCCOf[*SI] == SCCOf[N]) {
+                    HasCycle[SCCOf[N]] = true;
+                    continue;
+                }
+                SCCUsers[SCCOf[*SI]].push_back(SCCOf[N]);
+                ++NumDeps[SCCOf[N]];
+            }
+        }
+        Users.build(SCCUsers);
+    }
+
+    // Solve one SCC, all SCCs it reads from are final
+    auto Run = [&](unsigned Task) {
+        const std::vector<unsigned> &SCC = SCCs[Task];
+        bool ischanged;
+
+        do {
+            ischanged = false;
+
+            for (auto NI = SCC.begin(), NE = SCC.end(); NI != NE; ++NI) {
+                CAPArray_t V = Gen[*NI];
+                GatherUnionCAPArrays(V, Value, Sources.succ_begin(*NI),
+                                     Sources.succ_end(*NI));
+                ischanged |= UnionCAPArrays(Value[*NI], V);
+            }
+        } while (HasCycle[Task] && ischanged);
+    };
+
+    RunDAGTasks(Users, NumDeps, Run, NumThreads);
+}
+
+
+// Solve the same union dataflow problem by lock-free chaotic relaxation
+// Nodes are partitioned into contiguous ranges, one for each thread.
+// Threads relax dirty nodes of their own range asynchronously with
+// atomic fetch_or on each word of the values, and mark the users of
+// changed nodes dirty in any range. Pending counts the dirty nodes
+// and the nodes being relaxed. A node is counted before it is marked
+// dirty, so Pending never drops below the work left, and all threads
+// terminate when it drops to zero.
+// Experimental, the solution is the same least fixpoint.
+// param: Succs - the graph
+//        Preds - the reverse graph of Succs
+//        Gen - the gen set of each node
+//        Value - the solution, updated in place
+//        NumThreads - the number of threads
+template <DataflowDir_t Dir>
+void SolveDataflowChaotic(const CSRGraph &Succs, const CSRGraph &Preds,
+                          const CAPArray_t *Gen, CAPArray_t *Value,
+                          unsigned NumThreads)
+{
+    const CSRGraph &Sources = (Dir == DATAFLOW_BACKWARD) ? Succs : Preds;
+    const CSRGraph &Users = (Dir == DATAFLOW_BACKWARD) ? Preds : Succs;
+    unsigned NumNodes = Succs.getNumNodes();
+    unsigned RangeSize = (NumNodes + NumThreads - 1) / NumThreads;
+
+    std::unique_ptr<std::atomic<uint64_t>[]>
+        AtomicValue(new std::atomic<uint64_t>[(size_t)NumNodes * CAP_WORDS]);
+    std::unique_ptr<std::atomic<bool>[]>
+        Dirty(new std::atomic<bool>[NumNodes]);
+    std::unique_ptr<std::atomic<bool>[]>
+        HasWork(new std::atomic<bool>[NumThreads]);
+    std::atomic<unsigned> Pending(NumNodes);
+
+    for (unsigned N = 0; N != NumNodes; ++N) {
+        for (unsigned W = 0; W != CAP_WORDS; ++W) {
+            AtomicValue[N * CAP_WORDS + W].store(getCAPWord(Value[N], W));
+        }
+        Dirty[N].store(true);
+    }
+    for (unsigned T = 0; T != NumThreads; ++T) {
+        HasWork[T].store(true);
+    }
+
+    auto Worker = [&](unsigned Self) {
+        unsigned Begin = std::min(Self * RangeSize, NumNodes);
+        unsigned End = std::min(Begin + RangeSize, NumNodes);
+
+        while (Pending.load() != 0) {
+            if (!HasWork[Self].exchange(false)) {
+                std::this_thread::yield();
+                continue;
+            }
+
+            for (unsigned N = Begin; N != End; ++N) {
+                if (!Dirty[N].exchange(false)) { continue; }
+
+                CAPArray_t V = Gen[N];
+                for (const unsigned *SI = Sources.succ_begin(N),
+                         *SE = Sources.succ_end(N); SI != SE; ++SI) {
+                    for (unsigned W = 0; W != CAP_WORDS; ++W) {
+                        getCAPWord(V, W) |= AtomicValue[*SI * CAP_WORDS + W].load();
+                    }
+                }
+
+                // mark users dirty if the value is changed
+                bool ischanged = false;
+                for (unsigned W = 0; W != CAP_WORDS; ++W) {
+                    uint64_t Old = AtomicValue[N * CAP_WORDS + W].fetch_or(getCAPWord(V, W));
+                    ischanged |= (getCAPWord(V, W) & ~Old) != 0;
+                }
+                if (ischanged) {
+                    for (const unsigned *UI = Users.succ_begin(N),
+                             *UE = Users.succ_end(N); UI != UE; ++UI) {
+                        // count the user before it can be seen dirty,
+                        // and undo it if the user is already dirty
+                        Pending.fetch_add(1);
+                        if (!Dirty[*UI].exchange(true)) {
+                            HasWork[*UI / RangeSize].store(true);
+                        }
+                        else {
+                            Pending.fetch_sub(1);
+                        }
+                    }
+                }
+
+                Pending.fetch_sub(1);
+            }
+        }
+    };
+
+    std::vector<std::thread> Threads;
+    for (unsigned i = 1; i < NumThreads; ++i) {
+        Threads.push_back(std::thread(Worker, i));
+    }
+
+    Worker(0);
+
+    for (auto TI = Threads.begin(), TE = Threads.end(); TI != TE; ++TI) {
+        TI->join();
+    }
+
+    for (unsigned N = 0; N != NumNodes; ++N) {
+        for (unsigned W = 0; W != CAP_WORDS; ++W) {
+            getCAPWord(Value[N], W) = AtomicValue[N * CAP_WORDS + W].load();
+        }
+    }
+}
+
+
+// Solve with the parallel solver if more than one thread is
+// requested on the command line, or the sequential solver otherwise
+template <DataflowDir_t Dir>
+void SolveDataflowWithThreads(const CSRGraph &Succs, const CSRGraph &Preds,
+                              const std::vector<unsigned> &Priority,
+                              const CAPArray_t *Gen, CAPArray_t *Value)
+{
+    if (SolverThreads > 1) {
+        SolveDataflowParallel<Dir>(Succs, Preds, Gen, Value, SolverThreads);
+    }
+    else {
+        SolveDataflow<Dir>(Succs, Preds, Priority, Gen, Value);
+    }
+}
+
+} // namespace privAnalysis
+} // namespace llvm
+
+#endif
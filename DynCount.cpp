@@ -15,12 +15,16 @@
 #include "llvm/IR/LLVMContext.h"
 
 #include "DynCount.h"
+#include "SplitBB.h"
+#include "PrivCallGraph.h"
 
 
 using namespace llvm;
+using namespace llvm::splitBB;
 using namespace llvm::localAnalysis;
 using namespace llvm::propagateAnalysis;
 using namespace llvm::globalLiveAnalysis;
+using namespace llvm::privCallGraph;
 using namespace llvm::dynCount;
 
 
@@ -31,13 +35,17 @@ DynCount::DynCount() : ModulePass(ID) { };
 // Preserve analysis usage
 void DynCount::getAnalysisUsage(AnalysisUsage &AU) const
 {
+    AU.addRequired<SplitBB>();
     AU.addRequired<LocalAnalysis>();
     AU.addRequired<PropagateAnalysis>();
     AU.addRequired<GlobalLiveAnalysis>();
+    AU.addRequired<PrivCallGraph>();
 }
 
 
 // get add count function
+// addCount takes the CAPArray as one uint64_t, and addCountWide takes
+// the number of words and each word as uint64_t
 // param: M - module
 // return: pointer to addcount function
 Function* DynCount::getAddCountFunc(Module &M)
@@ -49,6 +57,17 @@ Function* DynCount::getAddCountFunc(Module &M)
     // First param for LOC
     Params.push_back(IntType);
 
+    if (CAP_WORDS > 1) {
+        // Second param for the number of words, followed by the words
+        Params.push_back(IntType);
+        FunctionType *AddCountFuncType = FunctionType::get(IntType,
+                                                           ArrayRef<Type *>(Params), true);
+        Constant *AddCountFunc = M.getOrInsertFunction(ADD_COUNT_WIDE_FUNC,
+                                                       AddCountFuncType);
+
+        return dyn_cast<Function>(AddCountFunc);
+    }
+
     // Second param for CAP set
     Params.push_back(Int64Type);
 
@@ -112,16 +131,22 @@ Function* DynCount::getAtExitFunc(Module &M)
 void DynCount::getAddCountArgs(std::vector<Value *>& Args, unsigned int LOC,
                                const CAPArray_t &CAPArray)
 {
-    uint64_t cap = CAPArray;
-
     // add to args vector
     Constant *LOCArg = ConstantInt::get
         (IntegerType::get(getGlobalContext(), 32), LOC);
     Args.push_back(LOCArg);
 
-    Constant *CAPArrayArg = ConstantInt::get
-        (IntegerType::get(getGlobalContext(), 64), cap);
-    Args.push_back(CAPArrayArg);
+    if (CAP_WORDS > 1) {
+        Constant *NumWordsArg = ConstantInt::get
+            (IntegerType::get(getGlobalContext(), 32), CAP_WORDS);
+        Args.push_back(NumWordsArg);
+    }
+
+    for (unsigned W = 0; W != CAP_WORDS; ++W) {
+        Constant *CAPArrayArg = ConstantInt::get
+            (IntegerType::get(getGlobalContext(), 64), getCAPWord(CAPArray, W));
+        Args.push_back(CAPArrayArg);
+    }
 
     return;
 }
@@ -137,23 +162,33 @@ bool DynCount::doInitialization(Module &M)
 // run on module
 bool DynCount::runOnModule(Module &M)
 {
-    LocalAnalysis &LA = getAnalysis<LocalAnalysis>();
+    SplitBB &SB = getAnalysis<SplitBB>();
     PropagateAnalysis &PA = getAnalysis<PropagateAnalysis>();
     GlobalLiveAnalysis &GA = getAnalysis<GlobalLiveAnalysis>();
+    const PrivCallGraph &CG = getAnalysis<PrivCallGraph>();
+    const ModuleNumbering &Numbering = SB.Numbering;
+
+    // Mark the redundant jmp BBs created by splitBB by BB IDs
+    std::vector<bool> IsExtraJMPBB(Numbering.getNumBBs(), false);
+    for (auto BI = SB.ExtraJMPBB.begin(), BE = SB.ExtraJMPBB.end();
+         BI != BE; ++BI) {
+        IsExtraJMPBB[Numbering.getBBID(*BI)] = true;
+    }
 
     // Add function to module 
     Function *addCountFunction = getAddCountFunc(M);
     // Insert callinst to all BBs 
     std::vector<Value *>Args;
-    FuncCAPTable_t FuncCAPTable = PA.FuncCAPTable;
+    const FuncCAPTable_t &FuncCAPTable = PA.FuncCAPTable;
 
     assert(addCountFunction && "The addCount function is NULL!\n");
 
     // iterate through all functions
     // for (Module::iterator FI = M.begin(), FE = M.end(); FI != FE; ++FI) {
-    for (auto FI = FuncCAPTable.begin(), FE = FuncCAPTable.end(); FI != FE; ++FI) {
-        Function *F = FI->first;
-        if (F == NULL) {
+    // functions not in the slice never run, so they are not counted
+    for (unsigned FID = 0, FE = FuncCAPTable.size(); FID != FE; ++FID) {
+        Function *F = Numbering.getFunc(FID);
+        if (F == NULL || !CG.isInSlice(FID)) {
             continue;
         }
 
@@ -164,25 +199,36 @@ bool DynCount::runOnModule(Module &M)
                 continue;
             }
 
+            // Insert addcount for all segments before the last one,
+            // a BB not split virtually has only one segment
+            unsigned BID = Numbering.getBBID(BB);
+            for (; !Numbering.isLastSegment(BID); ++BID) {
+                Args.clear();
+                getAddCountArgs(Args, Numbering.getSegmentSize(BID),
+                                GA.CAPSets.getSet(GA.getLiveIn(BID)));
+                CallInst::Create(addCountFunction, ArrayRef<Value *>(Args),
+                                 ADD_COUNT_FUNC, Numbering.getSegmentEnd(BID));
+            }
+
             Args.clear();
 
             // Get rid of the final JMP instruction, as its CAP set may 
             // be different than rest of the BasicBlock
-            unsigned long size = BB->size() - 1;
+            unsigned long size = Numbering.getSegmentSize(BID) - 1;
 
             // Insert addcount for all instructions in BB except terminator
-            getAddCountArgs(Args, size, GA.BBCAPTable_in[BB]);
+            getAddCountArgs(Args, size, GA.CAPSets.getSet(GA.getLiveIn(BID)));
             CallInst::Create(addCountFunction, ArrayRef<Value *>(Args),
                              ADD_COUNT_FUNC, BB->getTerminator());
 
             // Insert addcount for terminator if it's not redundant jmp
             // created by splitBB
-            if (findVector<BasicBlock*>(LA.ExtraJMPBB, BB)) {
+            if (IsExtraJMPBB[BID]) {
                 continue;
             }
             else {
                 Args.clear();
-                getAddCountArgs(Args, 1, GA.BBCAPTable_out[BB]);
+                getAddCountArgs(Args, 1, GA.CAPSets.getSet(GA.getLiveOut(BID)));
                 CallInst::Create(addCountFunction, ArrayRef<Value *>(Args),
                                  ADD_COUNT_FUNC, BB->getTerminator());
             }
@@ -218,28 +264,11 @@ bool DynCount::runOnModule(Module &M)
 }
 
 
-// find element in the element
-// V - the vector to search in
-// elem - the element to find
-// return: true if found, false otherwise
-template<typename T>
-bool DynCount::findVector(std::vector<T> V, T elem)
-{
-    for (auto I = V.begin(), E = V.end(); I != E; ++I) {
-        if (elem == (*I)) {
-            return true;
-        }
-    }
-    return false;
-}
-
-
-
 void DynCount::print(raw_ostream &O, const Module *M) const
 {
-    LocalAnalysis &LA = getAnalysis<LocalAnalysis>();
+    SplitBB &SB = getAnalysis<SplitBB>();
 
-    O << LA.ExtraJMPBB.size() << "\n";
+    O << SB.ExtraJMPBB.size() << "\n";
 }
 
 
@@ -24,9 +24,11 @@
 // The dynamic counting library API:
 // void initCount();
 // void addCount(int LOC, uint64_t CAPArray);
+// void addCountWide(int LOC, int NumWords, ...);
 // void reportCount();
 #define INIT_COUNT_FUNC "initCount"     
 #define ADD_COUNT_FUNC "addCount"       
+#define ADD_COUNT_WIDE_FUNC "addCountWide"
 #define REPORT_COUNT_FUNC "reportCount" 
 
 
@@ -65,14 +67,8 @@ private:
 
     void getAddCountArgs(std::vector<Value *>& Args, unsigned int LOC, 
                          const CAPArray_t &CAPArray);
-
-    template<typename T>
-    bool findVector(std::vector<T> V, T elem);
 };
 
-// template<typename T>
-// bool findVector(std::vector<T> V, T elem);
-
     
 
 } // namespace dynCount
@@ -40,7 +40,8 @@ bool ExternFunCall::runOnModule(Module &M)
     }
 
     // Iterate through all callees of instructions
-    CallGraph CG(M);
+    // The call graph is shared with other passes in the pipeline
+    CallGraph &CG = getAnalysis<CallGraphWrapperPass>().getCallGraph();
     CallGraphNode *externNode = CG.getExternalCallingNode();
 
     for (CallGraphNode::iterator NI = externNode->begin(), NE = externNode->end();
@@ -80,7 +81,9 @@ void ExternFunCall::print(raw_ostream &O, const Module *M) const
 // Get Analysis Usage from other passes
 void ExternFunCall::getAnalysisUsage(AnalysisUsage &AU) const 
 {
+    AU.addRequired<CallGraphWrapperPass>();
 
+    AU.setPreservesAll();
 }
 
 
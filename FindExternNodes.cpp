@@ -18,6 +18,8 @@
 
 
 #include "FindExternNodes.h"
+#include "SplitBB.h"
+#include "PrivCallGraph.h"
 
 #include <vector>
 
@@ -27,6 +29,8 @@ using namespace llvm::privAnalysis;
 using namespace llvm::localAnalysis;
 using namespace llvm::propagateAnalysis;
 using namespace llvm::findexternnodes;
+using namespace llvm::splitBB;
+using namespace llvm::privCallGraph;
 
 
 FindExternNodes::FindExternNodes() : ModulePass(ID) { } 
@@ -36,6 +40,8 @@ FindExternNodes::FindExternNodes() : ModulePass(ID) { }
 void FindExternNodes::getAnalysisUsage(AnalysisUsage &AU) const
 {
     AU.setPreservesCFG();
+    AU.addRequired<SplitBB>();
+    AU.addRequired<PrivCallGraph>();
     AU.addRequired<PropagateAnalysis>();
 
     AU.setPreservesAll();
@@ -53,33 +59,19 @@ bool FindExternNodes::doInitialization(Module &M)
 bool FindExternNodes::runOnModule(Module &M)
 {
     PropagateAnalysis &PA = getAnalysis<PropagateAnalysis>();
+    const PrivCallGraph &CG = getAnalysis<PrivCallGraph>();
+    const ModuleNumbering &Numbering = getAnalysis<SplitBB>().Numbering;
 
     // get data structures
-    FuncCAPTable_t FuncCAPTable;
-    
-    // get all nodes calling from externcallingnode
-    // TODO: problem here
-    for (auto FI = PA.FuncCAPTable.begin(), FE = PA.FuncCAPTable.end();
-         FI != FE; ++FI) {
-        if (!IsCAPArrayEmpty(FI->second)) {
-            FuncCAPTable[FI->first] = FI->second;
-        }
-    }
-
-    CallGraph CG(M);
-    CallGraphNode *externNode = CG.getExternalCallingNode();
-
-    for (CallGraphNode::iterator NI = externNode->begin(), NE = externNode->end();
-         NI != NE; ++NI) {
-        Function* CalledFunc = NI->second->getFunction();
-        assert(CalledFunc != NULL && "Callgraph node is NULL\n");
+    FuncCAPTable_t &FuncCAPTable = PA.FuncCAPTable;
+    ExternPrivNodes.assign(FuncCAPTable.size(), 0);
 
-        if (CalledFunc->empty()) { continue; }
-
-        if (FuncCAPTable.find(CalledFunc) != FuncCAPTable.end()) {
-            ExternPrivNodes[CalledFunc] = FuncCAPTable[CalledFunc];
-        }
+    // get all nodes calling from externcallingnode
+    for (const unsigned *CI = CG.Calls.succ_begin(CG.callingNodeID),
+             *CE = CG.Calls.succ_end(CG.callingNodeID); CI != CE; ++CI) {
+        if (Numbering.getFunc(*CI)->empty()) { continue; }
 
+        ExternPrivNodes[*CI] = FuncCAPTable[*CI];
     }
 
     return false;
@@ -89,10 +81,13 @@ bool FindExternNodes::runOnModule(Module &M)
 // print out 
 void FindExternNodes::print(raw_ostream &O, const Module *M) const
 {
-    for (auto FI = ExternPrivNodes.begin(), FE = ExternPrivNodes.end();
-         FI != FE; ++FI) {
-        O << FI->first->getName() << ":\t";
-        dumpCAPArray(O, FI->second);
+    const ModuleNumbering &Numbering = getAnalysis<SplitBB>().Numbering;
+
+    for (unsigned FID = 0, FE = ExternPrivNodes.size(); FID != FE; ++FID) {
+        if (IsCAPArrayEmpty(ExternPrivNodes[FID])) { continue; }
+
+        O << Numbering.getFunc(FID)->getName() << ":\t";
+        dumpCAPArray(O, ExternPrivNodes[FID]);
     }
 }
 
@@ -24,7 +24,6 @@
 #include "llvm/IR/Function.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Pass.h"
-#include "llvm/Analysis/CallGraph.h"
 #include "llvm/Support/raw_ostream.h"
 
 #include "ADT.h"
@@ -43,7 +42,8 @@ public:
     // pass ID
     static char ID;
 
-    // CAPTable after info propagation
+    // CAPTable after info propagation, indexed by function IDs
+    // from SplitBB, empty for functions not called externally
     FuncCAPTable_t ExternPrivNodes;
 
     FindExternNodes();
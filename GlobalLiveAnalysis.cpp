@@ -9,17 +9,22 @@
 #include "llvm/Analysis/CallGraph.h"
 #include "llvm/Pass.h"
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
-#include "llvm/Transforms/Utils/UnifyFunctionExitNodes.h"
+#include "llvm/ADT/PostOrderIterator.h"
 #include "llvm/IR/Dominators.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/Instructions.h"
-#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/Timer.h"
 
 #include "ADT.h"
 #include "GlobalLiveAnalysis.h"
 #include "DSAExternAnalysis.h"
 #include "PropagateAnalysis.h"
+#include "PrivCallGraph.h"
 #include "LocalAnalysis.h"
+#include "CAPKernels.h"
+#include "Dataflow.h"
 
 #include <utility>
 #include <algorithm>
@@ -30,11 +35,153 @@
 #include <cstdlib>
 
 using namespace llvm;
+using namespace llvm::localAnalysis;
 using namespace llvm::propagateAnalysis;
 using namespace llvm::splitBB;
 using namespace llvm::dsaexterntarget;
+using namespace llvm::privCallGraph;
 using namespace llvm::globalLiveAnalysis;
 
+#define DEBUG_TYPE "globallive"
+
+STATISTIC(NumRefinedFuncs, "Number of functions refined to BBs in the coarse mode");
+STATISTIC(NumLiveNodes, "Number of ICFG nodes the live analysis is solved on");
+STATISTIC(NumSolvedNodes, "Number of super-nodes the live fixpoint runs on");
+
+
+// Solvers of the live analysis
+enum LiveSolver_t {
+    LIVE_SOLVER_AUTO,
+    LIVE_SOLVER_WORKLIST,
+    LIVE_SOLVER_SCC,
+    LIVE_SOLVER_CHAOTIC
+};
+
+static cl::opt<LiveSolver_t> LiveSolver("priv-live-solver",
+    cl::desc("Solver of the global live analysis"),
+    cl::values(clEnumValN(LIVE_SOLVER_AUTO, "auto",
+                          "Worklist, or SCC if -priv-threads > 1"),
+               clEnumValN(LIVE_SOLVER_WORKLIST, "worklist",
+                          "Sequential worklist solver"),
+               clEnumValN(LIVE_SOLVER_SCC, "scc",
+                          "Parallel solver over the SCC DAG"),
+               clEnumValN(LIVE_SOLVER_CHAOTIC, "chaotic",
+                          "Lock-free chaotic relaxation (experimental)"),
+               clEnumValEnd),
+    cl::init(LIVE_SOLVER_AUTO));
+
+static cl::opt<bool> VerifySolver("priv-verify-solver",
+    cl::desc("Solve the live analysis again with the worklist solver, "
+             "and fail if the selected solver gives another solution"),
+    cl::init(false));
+
+static cl::opt<bool> LiveSummary("priv-live-summary",
+    cl::desc("Solve the live analysis in functions on their CFGs, and "
+             "apply the live at the exit of functions by summaries"),
+    cl::init(false));
+
+static cl::opt<bool> LiveCoarse("priv-live-coarse",
+    cl::desc("Solve the live analysis for functions on the call graph, and "
+             "refine BBs only in functions the coarse live set may drop in"),
+    cl::init(false));
+
+static cl::opt<bool> NoCollapse("priv-no-collapse",
+    cl::desc("Solve the live analysis on all BBs, without collapsing "
+             "BBs with no gen into super-nodes"),
+    cl::init(false));
+
+
+// Solve the backward union dataflow problem with the solver selected
+// on the command line
+// param: Succs - the graph
+//        Preds - the reverse graph of Succs
+//        Priority - the priority of each node for the worklist solver
+//        Gen - the gen set of each node
+//        Value - the solution, updated in place
+static void SolveLive(const CSRGraph &Succs, const CSRGraph &Preds,
+                      const std::vector<unsigned> &Priority,
+                      const CAPArray_t *Gen, CAPArray_t *Value)
+{
+    // Time the solver alone with -time-passes, to compare solvers
+    NamedRegionTimer T("Live analysis solver", "PrivAnalysis solvers",
+                       TimePassesIsEnabled);
+    unsigned NumThreads = std::max(1U, (unsigned)SolverThreads);
+
+    // Keep the initial values to solve again for the check
+    std::vector<CAPArray_t> Check;
+    if (VerifySolver) {
+        Check.assign(Value, Value + Succs.getNumNodes());
+    }
+
+    switch (LiveSolver) {
+    case LIVE_SOLVER_WORKLIST:
+        SolveDataflow<DATAFLOW_BACKWARD>(Succs, Preds, Priority, Gen, Value);
+        break;
+    case LIVE_SOLVER_SCC:
+        SolveDataflowParallel<DATAFLOW_BACKWARD>(Succs, Preds, Gen, Value,
+                                                 NumThreads);
+        break;
+    case LIVE_SOLVER_CHAOTIC:
+        SolveDataflowChaotic<DATAFLOW_BACKWARD>(Succs, Preds, Gen, Value,
+                                                NumThreads);
+        break;
+    default:
+        SolveDataflowWithThreads<DATAFLOW_BACKWARD>(Succs, Preds, Priority,
+                                                    Gen, Value);
+        break;
+    }
+
+    if (VerifySolver) {
+        SolveDataflow<DATAFLOW_BACKWARD>(Succs, Preds, Priority, Gen,
+                                         Check.data());
+        if (!std::equal(Check.begin(), Check.end(), Value)) {
+            report_fatal_error("Live analysis solver differs from the "
+                               "worklist solver");
+        }
+    }
+}
+
+
+// Order the nodes of a function for the solver, BBs in reverse post
+// order, then BBs unreachable from the entry, then the virtual exit.
+// Segments of a BB are ordered one after another.
+// param: Numbering - the numbering of functions and BBs
+//        Graph - the ICFG, only the calls are needed
+//        FID - the function
+//        NodeOrder - the order of each node to save to
+//        Nodes - the nodes to append to in the order
+static void OrderFuncNodes(const ModuleNumbering &Numbering, const ICFG &Graph,
+                           unsigned FID, std::vector<unsigned> &NodeOrder,
+                           std::vector<unsigned> &Nodes)
+{
+    Function *F = Numbering.getFunc(FID);
+    if (F == NULL || F->empty()) { return; }
+
+    ReversePostOrderTraversal<Function*> RPOT(F);
+    for (auto RI = RPOT.begin(), RE = RPOT.end(); RI != RE; ++RI) {
+        unsigned BID = Numbering.getBBID(*RI);
+        do {
+            NodeOrder[BID] = Nodes.size();
+            Nodes.push_back(BID);
+        } while (!Numbering.isLastSegment(BID++));
+    }
+
+    for (Function::iterator BI = F->begin(), BE = F->end(); BI != BE; ++BI) {
+        unsigned BID = Numbering.getBBID(&*BI);
+        if (NodeOrder[BID] != INVALID_ID) { continue; }
+        do {
+            NodeOrder[BID] = Nodes.size();
+            Nodes.push_back(BID);
+        } while (!Numbering.isLastSegment(BID++));
+    }
+
+    unsigned Exit = Graph.ExitBB[FID];
+    if (Exit != INVALID_ID && Graph.isVirtualExit(Exit)) {
+        NodeOrder[Exit] = Nodes.size();
+        Nodes.push_back(Exit);
+    }
+}
+
 
 // GlobalLiveAnalysis constructor
 GlobalLiveAnalysis::GlobalLiveAnalysis() : ModulePass(ID) {}
@@ -45,9 +192,10 @@ void GlobalLiveAnalysis::getAnalysisUsage(AnalysisUsage &AU) const
 {
     AU.setPreservesAll();
 
-    AU.addRequired<UnifyFunctionExitNodes>();
     AU.addRequired<DSAExternAnalysis>();
+    AU.addRequired<LocalAnalysis>();
     AU.addRequired<PropagateAnalysis>();
+    AU.addRequired<PrivCallGraph>();
     AU.addRequired<SplitBB>();
 }
 
@@ -63,158 +211,210 @@ bool GlobalLiveAnalysis::doInitialization(Module &M)
 bool GlobalLiveAnalysis::runOnModule(Module &M)
 {
     PropagateAnalysis &PA = getAnalysis<PropagateAnalysis>();
+    SplitBB &SB = getAnalysis<SplitBB>();
+    ModuleNumbering &Numbering = SB.Numbering;
 
-    // retrieve all data structures
-    FuncCAPTable_t &FuncUseCAPTable = PA.FuncCAPTable;
-    // TODO: retrieve information directly from LocalAnalysis?
-    BBCAPTable_t &BBCAPTable = PA.BBCAPTable;
-    BBFuncTable_t &BBFuncTable = PA.BBFuncTable;
-
-    Function* callsNodeFunc = PA.callsNodeFunc;
+    // retrieve all data structures, read only from the passes
+    // BBs numbered after the tables are built are not in the tables
+    const FuncCAPTable_t &FuncUseCAPTable = PA.FuncCAPTable;
+    const BBCAPTable_t &BBCAPTable = getAnalysis<LocalAnalysis>().BBCAPTable;
 
     const DSAExternAnalysis &DSAFinder = getAnalysis<DSAExternAnalysis>();
-    CallSiteFunMap_t callsToExternNode = DSAFinder.callsToExternNode;
-    InstrFunMap_t instFunMap = DSAFinder.instFunMap;
-
-    // find the returnBB of all functions
-    FuncReturnBB_t funcReturnBB;
-    findReturnBB(M, funcReturnBB);
-
-    // init data structure
-    bool ischanged;
-
-    // iterate the algorithm till convergence
-    do {
-        ischanged = false;
-
-        // iterate through all functions
-        for (auto FI = FuncUseCAPTable.begin(), FE = FuncUseCAPTable.end(); 
-             FI != FE; ++FI) {
-            Function *F = FI->first;
-            if (F == NULL || F->empty()) { continue; }
-
-            // Iterate through all BBs for information propagation
-            // Traversing BBs in reverse order now because it's closer to
-            // topologically reverse order of how BBs are arranged in LLVM, 
-            // and it's faster for dataflow analysis to converge
-            Function::iterator BI = F->end(), BBegin = F->begin();
-            while (1) {
-                if (BI != BBegin) { --BI; }
-                else { break; }
-
-                BasicBlock *B = dyn_cast<BasicBlock>(BI);
-                if (B == NULL) { continue; }
-
-                // ---------------------------------------------------------- //
-                // Propagate information in each BB
-                // ---------------------------------------------------------- //
-                // if it's a FunCall BB (found as key in BBFuncTable), add the 
-                // live info to CAPTable of callee's exit BB
-                // TODO: Consider cases for external nodes and 
-                // TODO: DSA related info here
-                if (BBFuncTable.find(B) != BBFuncTable.end()) {
-                    Function* funcall = BBFuncTable[B];
-
-                    // Find the callinst of the BB
-                    Instruction* BBcallInst = B->getFirstNonPHI();
-
-                    CallSite CS(BBcallInst);
-
-                    // If calling to externnode
-                    if (callsToExternNode.find(&CS) != callsToExternNode.end()) {
-
-                        // Skip LLVM intrinsic functions
-                        if (isa<IntrinsicInst>(BBcallInst)) { continue; }
-
-                        // DEBUG
-                        errs() << "Empty function: " << funcall->getName() << "\n";
-
-                        // If complete from DSA analysis
-                        if (instFunMap.find(BBcallInst) != instFunMap.end()) {
-                            std::vector<Function*> Instcallees = instFunMap[BBcallInst];
-                            for (std::vector<Function*>::iterator II = Instcallees.begin(),
-                                     IE = Instcallees.end(); II != IE; ++II) {
-                                Function* callee = *II;
-                                ischanged |= UnionCAPArrays(BBCAPTable_in[B],
-                                                            FuncUseCAPTable[callee]);
-                                ischanged |= UnionCAPArrays(BBCAPTable_out[funcReturnBB[callee]],
-                                                            BBCAPTable_out[B]);
-                            }
-                        }
-                        // else if incomplete, propagate from callsExternNode
-                        else {
-                            ischanged |= UnionCAPArrays(BBCAPTable_in[B],
-                                                        FuncUseCAPTable[callsNodeFunc]);
-                        }
-                    }
-
-                    ischanged |= UnionCAPArrays(BBCAPTable_in[B],
-                                                FuncUseCAPTable[funcall]);
-                    // propagate information to returnBB of function
-                    Function *callee = BBFuncTable[B];
-                    ischanged |= UnionCAPArrays(BBCAPTable_out[funcReturnBB[callee]],
-                                                BBCAPTable_out[B]);
-                }
-
-                // if it's a Priv Call BB, Propagate privilege to the in of BB
-                if (BBCAPTable.find(B) != BBCAPTable.end()) {
-                    ischanged |= UnionCAPArrays(BBCAPTable_in[B], BBCAPTable[B]);
-                    //ischangedFunc |= ischanged;
-                }
-
-                // propagate from all its successors
-                TerminatorInst *BBTerm = B->getTerminator();
-
-                for (unsigned BSI = 0, BSE = BBTerm->getNumSuccessors(); 
-                     BSI != BSE; ++ BSI) {
-                    BasicBlock *SuccessorBB = BBTerm->getSuccessor(BSI);
-                    assert(SuccessorBB && "Successor BB is NULL!");
-                    ischanged |= UnionCAPArrays(BBCAPTable_out[B], 
-                                                BBCAPTable_in[SuccessorBB]);
-                    // ischangedFunc |= ischanged;
-                }
-                // propagate live info from out[B] to in[B] for each BB
-                ischanged |= UnionCAPArrays(BBCAPTable_in[B], BBCAPTable_out[B]);
-            } // iterate all BBs
-
-        } // iterate all functions
-    } while (ischanged); // main loop
+    const PrivCallGraph &CG = getAnalysis<PrivCallGraph>();
+
+    // Time the whole analysis with -time-passes, to compare the
+    // coarse mode with the others
+    NamedRegionTimer T("Live analysis", "PrivAnalysis solvers",
+                       TimePassesIsEnabled);
+
+    // init data structure, sized after all BBs are numbered
+    CAPSets.clear();
+    FuncLiveCAPTable_in.assign(Numbering.getNumFuncs(), 0);
+    FuncLiveCAPTable_out.assign(Numbering.getNumFuncs(), 0);
+
+    // In the coarse mode only the call edges are built for all BBs,
+    // the edges of BBs only for the functions refined
+    if (LiveCoarse) {
+        Graph.buildCalls(Numbering, SB.BBFuncTable, SB.UnsplitCalls,
+                         DSAFinder.callTargetIndex, CG.InSlice);
+        solveCoarse(FuncUseCAPTable, BBCAPTable, CG.InSlice);
+        return false;
+    }
 
-    // ------------------------------------------ //
-    // Find Difference of BB in and out CAPArrays
-    // Save it to the output 
-    // ------------------------------------------ //
-    for (auto bi = BBCAPTable_out.begin(); bi != BBCAPTable_out.end(); ++bi) {
-        BasicBlock *B = bi->first;
-        if (B == NULL ) { continue; }
+    // Build the ICFG once, the solver only runs on the ICFG
+    // The exits of functions are virtual nodes after all BBs
+    Graph.build(Numbering, SB.BBFuncTable, SB.UnsplitCalls,
+                DSAFinder.callTargetIndex, CG.InSlice);
+    unsigned NumBBs = Graph.getNumBBs();
+    unsigned NumNodes = Graph.getNumNodes();
+    NumLiveNodes += NumNodes;
+
+    // ---------------------------------------------------------- //
+    // The gen set of each BB: the privileges raised in the BB,
+    // and the privileges used by all callees of the BB. BBs of
+    // functions not in the slice never run, and have no gen.
+    // ---------------------------------------------------------- //
+    BBCAPTable_t BBCAPTable_gen(NumNodes, 0);
+    std::copy(BBCAPTable.begin(), BBCAPTable.end(), BBCAPTable_gen.begin());
+
+    for (unsigned BID = 0; BID != NumBBs; ++BID) {
+        if (!CG.isInSlice(Graph.BBFunc[BID])) {
+            BBCAPTable_gen[BID] = CAPArray_t(0);
+            continue;
+        }
 
-        CAPArray_t &CAPArray_out = bi->second;
-        CAPArray_t &CAPArray_in = BBCAPTable_in[B];
+        GatherUnionCAPArrays(BBCAPTable_gen[BID], FuncUseCAPTable.data(),
+                             Graph.CallTargets.succ_begin(BID),
+                             Graph.CallTargets.succ_end(BID));
+    }
 
-        // compare the in and the out of the same BB
-        if (DiffCAPArrays(BBCAPTable_dropEnd[B], CAPArray_in, CAPArray_out) == 0) {
-            BBCAPTable_dropEnd.erase(B);
+    // ---------------------------------------------------------- //
+    // Priority of BBs for the solver. BBs of each function are
+    // ordered in reverse post order, so visiting the largest order
+    // first visits BBs in post order, which is the fast order for
+    // a backward dataflow problem. BBs unreachable from the entry
+    // and the virtual exit are ordered after them.
+    // ---------------------------------------------------------- //
+    std::vector<unsigned> BBOrder(NumNodes, INVALID_ID);
+    std::vector<unsigned> OrderedNodes;
+
+    for (unsigned FID = 0, FE = Numbering.getNumFuncs(); FID != FE; ++FID) {
+        OrderFuncNodes(Numbering, Graph, FID, BBOrder, OrderedNodes);
+    }
+    std::vector<unsigned>().swap(OrderedNodes);
+
+    // ---------------------------------------------------------- //
+    // In the summary mode, only the edges in functions are solved,
+    // and the ICFG edges out of exits are applied by function summaries
+    // ---------------------------------------------------------- //
+    CSRGraph CFGSuccs;
+    if (LiveSummary) {
+        CFGSuccs.Offsets.assign(1, 0);
+        for (unsigned BID = 0; BID != NumNodes; ++BID) {
+            CFGSuccs.Targets.insert(CFGSuccs.Targets.end(),
+                                    Graph.cfg_succ_begin(BID),
+                                    Graph.intra_succ_end(BID));
+            CFGSuccs.Offsets.push_back(CFGSuccs.Targets.size());
         }
+    }
+    const CSRGraph &LiveSuccs = LiveSummary ? CFGSuccs : Graph.Succs;
+
+    // ---------------------------------------------------------- //
+    // Collapse BBs with no gen into super-nodes. The live in of
+    // such a BB is the union of its successors, so chains and
+    // single exit regions of them have the live in of the BB they
+    // exit to. The solver only runs on the super-nodes, with the
+    // gen and the priority of their representative BBs.
+    // ---------------------------------------------------------- //
+    std::vector<bool> IsIdentity(NumNodes, false);
+    if (!NoCollapse) {
+        for (unsigned BID = 0; BID != NumNodes; ++BID) {
+            IsIdentity[BID] = IsCAPArrayEmpty(BBCAPTable_gen[BID]);
+        }
+    }
 
-        // compare the out with all ins of the child BB, put in drop start of children
-        const TerminatorInst *BBTerm = B->getTerminator();
+    CSRGraph SuperSuccs;
+    CSRGraph SuperPreds;
+    unsigned NumSuperNodes = CollapseIdentityNodes(LiveSuccs, IsIdentity,
+                                                   BBSuperNode, SuperNodeBB,
+                                                   SuperSuccs);
+    SuperPreds.buildReverse(SuperSuccs);
+    std::vector<bool>().swap(IsIdentity);
+    CFGSuccs = CSRGraph();
+
+    BBCAPTable_t SuperLive_in(NumSuperNodes, 0);
+    BBCAPTable_t SuperGen(NumSuperNodes);
+    std::vector<unsigned> SuperOrder(NumSuperNodes);
+    for (unsigned S = 0; S != NumSuperNodes; ++S) {
+        SuperGen[S] = BBCAPTable_gen[SuperNodeBB[S]];
+        SuperOrder[S] = BBOrder[SuperNodeBB[S]];
+    }
+    BBCAPTable_t().swap(BBCAPTable_gen);
+
+    // ---------------------------------------------------------- //
+    // Solve live in of each super-node:
+    //   in[B] = gen[B] | in[S] for all ICFG successors S of B
+    // where the ICFG successors of the exit BB of a function are
+    // the return sites of all its call sites. In the summary mode
+    // only the CFG successors are solved, and the live at the exit
+    // of each function is filled in after, solved on the CFGs.
+    // ---------------------------------------------------------- //
+    SolveLive(SuperSuccs, SuperPreds, SuperOrder, SuperGen.data(),
+              SuperLive_in.data());
+    NumSolvedNodes += NumSuperNodes;
+
+    FuncCAPTable_t FuncLive_exit;
+    if (LiveSummary) {
+        applySummaries(SuperPreds, SuperLive_in, FuncLive_exit);
+    }
+
+    // Intern the live in of each super-node, the solution is freed after
+    SuperCAPTable_in.resize(NumSuperNodes);
+    for (unsigned S = 0; S != NumSuperNodes; ++S) {
+        SuperCAPTable_in[S] = CAPSets.intern(SuperLive_in[S]);
+    }
+    BBCAPTable_t().swap(SuperLive_in);
+    BBCAPTable_t().swap(SuperGen);
+
+    // live out of each representative BB is the union of the
+    // super-nodes of its ICFG successors. In the summary mode, the
+    // return sites of exit BBs are the live at the exit instead.
+    SuperCAPTable_out.assign(NumSuperNodes, CAPSET_EMPTY);
+    for (unsigned S = 0; S != NumSuperNodes; ++S) {
+        CAPSetID_t &Out = SuperCAPTable_out[S];
+        for (const unsigned *SI = SuperSuccs.succ_begin(S),
+                 *SE = SuperSuccs.succ_end(S); SI != SE; ++SI) {
+            Out = CAPSets.unionSets(Out, SuperCAPTable_in[*SI]);
+        }
+    }
 
-        for(unsigned BSI = 0, BSE = BBTerm->getNumSuccessors(); 
-            BSI != BSE; ++ BSI) {
-            BasicBlock *SuccessorBB = BBTerm->getSuccessor(BSI);
-            CAPArray_t CAPSuccessor_in = BBCAPTable_in[SuccessorBB];
+    if (LiveSummary) {
+        for (unsigned FID = 0, FE = Graph.ExitBB.size(); FID != FE; ++FID) {
+            if (Graph.ExitBB[FID] == INVALID_ID) { continue; }
 
-            DiffCAPArrays(BBCAPTable_dropStart[SuccessorBB], 
-                          CAPArray_out, CAPSuccessor_in);
+            CAPSetID_t &Out = SuperCAPTable_out[BBSuperNode[Graph.ExitBB[FID]]];
+            Out = CAPSets.unionSets(Out, CAPSets.intern(FuncLive_exit[FID]));
         }
     }
 
-    // Remove unnecessary BBDropstart
-    for (auto bi = BBCAPTable_out.begin(); 
-         bi != BBCAPTable_out.end(); ++bi) {
+    // The live in and live out of functions, at the entry BB and the exit
+    for (unsigned FID = 0, FE = Graph.ExitBB.size(); FID != FE; ++FID) {
+        if (!CG.isInSlice(FID)) { continue; }
+
+        unsigned Entry = Graph.EntryBB[FID];
+        if (Entry != INVALID_ID) {
+            FuncLiveCAPTable_in[FID] = CAPSets.getSet(getLiveIn(Entry));
+        }
 
-        if (IsCAPArrayEmpty(BBCAPTable_dropStart[bi->first])) {
-            BBCAPTable_dropStart.erase(bi->first);
+        // the virtual exit has the return sites as successors
+        unsigned Exit = Graph.ExitBB[FID];
+        if (Exit != INVALID_ID) {
+            FuncLiveCAPTable_out[FID] = CAPSets.getSet(Graph.isVirtualExit(Exit) ?
+                                                       getLiveIn(Exit) :
+                                                       getLiveOut(Exit));
+        }
+    }
+
+    // ------------------------------------------ //
+    // Find Difference of BB in and out CAPArrays
+    // Save it to the output 
+    // ------------------------------------------ //
+    BBCAPTable_dropEnd.assign(NumBBs, CAPSET_EMPTY);
+    BBCAPTable_dropStart.assign(NumBBs, CAPSET_EMPTY);
+
+    for (unsigned BID = 0; BID != NumBBs; ++BID) {
+        CAPSetID_t Out = getLiveOut(BID);
+
+        // compare the in and the out of the same BB
+        BBCAPTable_dropEnd[BID] = CAPSets.diffSets(getLiveIn(BID), Out);
+
+        // compare the out with all ins of the child BB, put in drop start of children
+        for (const unsigned *SI = Graph.cfg_succ_begin(BID),
+                 *SE = Graph.cfg_succ_end(BID); SI != SE; ++SI) {
+            CAPSetID_t Drop = CAPSets.diffSets(Out, getLiveIn(*SI));
+
+            BBCAPTable_dropStart[*SI] = CAPSets.unionSets(BBCAPTable_dropStart[*SI],
+                                                          Drop);
         }
     }
 
@@ -224,75 +424,444 @@ bool GlobalLiveAnalysis::runOnModule(Module &M)
     // Dump the table for debugging
     // dumpTable();
 
-    // Find unique set for debug output or ROSA
-    // findUniqueSet();
-
     return false;
 }
 
 
-// get the unique privilege set, save the result to CAPSet
-void GlobalLiveAnalysis::findUniqueSet()
+// Apply the summaries of functions to the live in solved on CFGs
+// The summary of a function is its gen, the CAPs used by it, which
+// calls already have in the gen of their BBs, and if a BB passes
+// through to the exit BB. With G[S] solved on the CFG only, i.e.
+// nothing is live after the function returns, the live in is
+//   in[S] = G[S] | (S reaches the exit BB ? exit[F] : 0)
+// where exit[F] of the function F of S is the live at its exit BB,
+// the live in of the return sites of all calls to F:
+//   exit[F] = G[R] for return sites R of calls to F
+//           | exit[C] for callers C with such R reaching their exit
+// exit[] is solved on the call graph, so each callee is walked once
+// in the final top-down fill, not once for each caller fact.
+// param: SuperPreds - the CFG predecessors of each super-node
+//        SuperLive - G of each super-node, updated to the live in
+//        FuncLive_exit - the live at the exit of each function to save to
+void GlobalLiveAnalysis::applySummaries(const CSRGraph &SuperPreds,
+                                        BBCAPTable_t &SuperLive,
+                                        FuncCAPTable_t &FuncLive_exit)
 {
-    // Analyze BBCAPTable_in
-    for (auto BI = BBCAPTable_in.begin(), BE = BBCAPTable_in.end();
-         BI != BE; ++BI) {
-        if (CAPSet.find(BI->second) == CAPSet.end()) {
-            CAPSet[BI->second] = findCAPArraySize(BI->second);
+    const ModuleNumbering &Numbering = getAnalysis<SplitBB>().Numbering;
+    unsigned NumSuperNodes = SuperNodeBB.size();
+    unsigned NumFuncs = Graph.ExitBB.size();
+
+    std::vector<unsigned> SuperFunc(NumSuperNodes);
+    for (unsigned S = 0; S != NumSuperNodes; ++S) {
+        SuperFunc[S] = Graph.BBFunc[SuperNodeBB[S]];
+    }
+
+    // Pass through: the super-nodes reaching the exit BB of their function
+    std::vector<bool> ReachExit(NumSuperNodes, false);
+    std::vector<unsigned> Worklist;
+    for (unsigned FID = 0; FID != NumFuncs; ++FID) {
+        if (Graph.ExitBB[FID] == INVALID_ID) { continue; }
+
+        unsigned S = BBSuperNode[Graph.ExitBB[FID]];
+        ReachExit[S] = true;
+        Worklist.push_back(S);
+    }
+
+    while (!Worklist.empty()) {
+        unsigned S = Worklist.back();
+        Worklist.pop_back();
+
+        for (const unsigned *PI = SuperPreds.succ_begin(S),
+                 *PE = SuperPreds.succ_end(S); PI != PE; ++PI) {
+            if (!ReachExit[*PI]) {
+                ReachExit[*PI] = true;
+                Worklist.push_back(*PI);
+            }
+        }
+    }
+
+    solveFuncExits(SuperLive, ReachExit, SuperFunc, FuncLive_exit);
+
+    // Fill in the live at the exit top-down
+    for (unsigned S = 0; S != NumSuperNodes; ++S) {
+        if (ReachExit[S]) {
+            UnionCAPArrays(SuperLive[S], FuncLive_exit[SuperFunc[S]]);
         }
     }
 }
 
 
-// find the exit BB of all functions using Unify Exit Node
-void GlobalLiveAnalysis::findReturnBB(Module &M, FuncReturnBB_t& FuncReturnBB)
+// Solve the live at the exit of each function on the call graph
+//   exit[F] = G[R] for return sites R of calls to F
+//           | exit[C] for callers C with such R reaching their exit
+// param: SuperLive - G of each super-node
+//        ReachExit - if each super-node reaches the exit of its function
+//        SuperFunc - the function ID of each super-node
+//        FuncLive_exit - the live at the exit of each function to save to
+void GlobalLiveAnalysis::solveFuncExits(const BBCAPTable_t &SuperLive,
+                                        const std::vector<bool> &ReachExit,
+                                        const std::vector<unsigned> &SuperFunc,
+                                        FuncCAPTable_t &FuncLive_exit)
 {
-    for (auto FI = M.begin(), FE = M.end(); FI != FE; ++FI) {
-        Function *F = dyn_cast<Function>(FI);
-        if (F == NULL || F->empty()) {
+    unsigned NumFuncs = Graph.ExitBB.size();
+
+    // The return sites of each call BB applied to its callees, and
+    // the callers passing their exit to the callees
+    FuncCAPTable_t RetGen(NumFuncs, 0);
+    AdjList_t CallerAdj(NumFuncs);
+
+    for (unsigned BID = 0, BE = BBSuperNode.size(); BID != BE; ++BID) {
+        if (Graph.CallTargets.succ_begin(BID) == Graph.CallTargets.succ_end(BID)) {
             continue;
         }
 
-        // Find the exit node of the Function
-        // TODO: Separate UnifyExitNodes as an individual transformation pass?
-        UnifyFunctionExitNodes &UnifyExitNode = getAnalysis<UnifyFunctionExitNodes>(*F);
-        UnifyExitNode.runOnFunction(*F);
-        BasicBlock *ReturnBB = UnifyExitNode.getReturnBlock();
-        BasicBlock *UnReachableBB = UnifyExitNode.getUnreachableBlock();
-        BasicBlock *UnwindBB = UnifyExitNode.getUnwindBlock();
+        CAPArray_t Ret(0);
+        bool RetReachExit = false;
+        for (const unsigned *SI = Graph.cfg_succ_begin(BID),
+                 *SE = Graph.cfg_succ_end(BID); SI != SE; ++SI) {
+            UnionCAPArrays(Ret, SuperLive[BBSuperNode[*SI]]);
+            RetReachExit |= ReachExit[BBSuperNode[*SI]];
+        }
+
+        unsigned Caller = SuperFunc[BBSuperNode[BID]];
+        for (const unsigned *CI = Graph.CallTargets.succ_begin(BID),
+                 *CE = Graph.CallTargets.succ_end(BID); CI != CE; ++CI) {
+            if (Graph.ExitBB[*CI] == INVALID_ID) { continue; }
+
+            UnionCAPArrays(RetGen[*CI], Ret);
+            if (RetReachExit) { CallerAdj[Caller].push_back(*CI); }
+        }
+    }
+
+    for (auto AI = CallerAdj.begin(), AE = CallerAdj.end(); AI != AE; ++AI) {
+        std::sort(AI->begin(), AI->end());
+        AI->erase(std::unique(AI->begin(), AI->end()), AI->end());
+    }
 
-        assert(UnwindBB == NULL && "So far not dealing with unwind block\n");
-        assert((ReturnBB != NULL || UnReachableBB != NULL) && "Return BB is NULL\n");
+    CSRGraph CallerSuccs;
+    CSRGraph CallerPreds;
+    CallerSuccs.build(CallerAdj);
+    CallerPreds.buildReverse(CallerSuccs);
+    AdjList_t().swap(CallerAdj);
 
-        FuncReturnBB[F] = ReturnBB;
+    // callers are visited before callees in the order of function IDs
+    std::vector<unsigned> FuncOrder(NumFuncs);
+    for (unsigned FID = 0; FID != NumFuncs; ++FID) {
+        FuncOrder[FID] = NumFuncs - FID;
     }
+
+    FuncLive_exit.assign(NumFuncs, 0);
+    SolveDataflow<DATAFLOW_FORWARD>(CallerSuccs, CallerPreds, FuncOrder,
+                                    RetGen.data(), FuncLive_exit.data());
 }
 
 
-// helper function for sorting alogrithm used in print
-bool compareSet(const std::pair<CAPArray_t, int> A,
-                const std::pair<CAPArray_t, int> B)
+// Solve the coarse live in and live out of each function
+// The live out is solved on the call graph by the ICFG, and
+//   in[F] = use[F] | out[F]
+// which is safe for all BBs of F. The live at BBs only refines it
+// where the coarse live in is neither empty nor all CAPs used.
+// param: FuncUse - the CAPs used by each function and its callees
+//        InSlice - if each function is in the slice
+//        FuncRefined - if the BBs of each function are refined, to save to
+void GlobalLiveAnalysis::findCoarseLive(const FuncCAPTable_t &FuncUse,
+                                        const std::vector<bool> &InSlice,
+                                        std::vector<bool> &FuncRefined)
 {
-    return (A.second > B.second);
+    unsigned NumFuncs = Graph.ExitBB.size();
+
+    Graph.findCoarseLiveOut(FuncUse, FuncLiveCAPTable_out);
+
+    // All CAPs used in the slice, the most a live in can be
+    CAPArray_t AllUsed(0);
+    for (unsigned FID = 0; FID != NumFuncs; ++FID) {
+        if (InSlice[FID]) { UnionCAPArrays(AllUsed, FuncUse[FID]); }
+    }
+
+    FuncRefined.assign(NumFuncs, false);
+    for (unsigned FID = 0; FID != NumFuncs; ++FID) {
+        if (!InSlice[FID]) {
+            FuncLiveCAPTable_out[FID] = CAPArray_t(0);
+            continue;
+        }
+
+        CAPArray_t &In = FuncLiveCAPTable_in[FID];
+        In = FuncUse[FID];
+        if (Graph.ExitBB[FID] != INVALID_ID) {
+            UnionCAPArrays(In, FuncLiveCAPTable_out[FID]);
+        }
+
+        FuncRefined[FID] = !IsCAPArrayEmpty(In) && In != AllUsed;
+        if (FuncRefined[FID]) { ++NumRefinedFuncs; }
+    }
+}
+
+
+// Solve the live analysis in the coarse mode
+// The live in and live out of functions are solved on the call graph
+// first. BBs are only refined in functions with a coarse live in
+// neither empty nor all CAPs used: the edges of their BBs are built
+// in a local numbering, collapsed and solved on their CFGs, with the
+// coarse live out at their exits. All BBs of the other functions
+// have the coarse live in, and return BBs have the coarse live out,
+// so they share one super-node for each function and each return BB.
+// param: FuncUse - the CAPs used by each function and its callees
+//        BBCAPTable - the CAPs raised in each BB
+//        InSlice - if each function is in the slice
+void GlobalLiveAnalysis::solveCoarse(const FuncCAPTable_t &FuncUse,
+                                     const BBCAPTable_t &BBCAPTable,
+                                     const std::vector<bool> &InSlice)
+{
+    const ModuleNumbering &Numbering = getAnalysis<SplitBB>().Numbering;
+    unsigned NumBBs = Graph.getNumBBs();
+    unsigned NumNodes = Graph.getNumNodes();
+    unsigned NumFuncs = Graph.ExitBB.size();
+
+    std::vector<bool> FuncRefined;
+    findCoarseLive(FuncUse, InSlice, FuncRefined);
+
+    // ---------------------------------------------------------- //
+    // Number the nodes of the refined functions locally, in the
+    // order for the solver, and build their edges and gen sets
+    // ---------------------------------------------------------- //
+    std::vector<unsigned> LocalID(NumNodes, INVALID_ID);
+    std::vector<unsigned> LocalNode;
+    for (unsigned FID = 0; FID != NumFuncs; ++FID) {
+        if (FuncRefined[FID]) {
+            OrderFuncNodes(Numbering, Graph, FID, LocalID, LocalNode);
+        }
+    }
+    unsigned NumLocal = LocalNode.size();
+    NumLiveNodes += NumLocal;
+
+    CSRGraph LocalSuccs;
+    std::vector<unsigned> NumLocalCFGSuccs(NumLocal);
+    std::vector<unsigned> Succs;
+    BBCAPTable_t LocalGen(NumLocal, 0);
+    LocalSuccs.Offsets.assign(1, 0);
+
+    for (unsigned L = 0; L != NumLocal; ++L) {
+        unsigned N = LocalNode[L];
+
+        // BBs only have successors in the same function
+        Succs.clear();
+        NumLocalCFGSuccs[L] = Graph.appendIntraSuccs(Numbering, N, Succs);
+        for (auto SI = Succs.begin(), SE = Succs.end(); SI != SE; ++SI) {
+            LocalSuccs.Targets.push_back(LocalID[*SI]);
+        }
+        LocalSuccs.Offsets.push_back(LocalSuccs.Targets.size());
+
+        if (N < BBCAPTable.size()) { LocalGen[L] = BBCAPTable[N]; }
+        GatherUnionCAPArrays(LocalGen[L], FuncUse.data(),
+                             Graph.CallTargets.succ_begin(N),
+                             Graph.CallTargets.succ_end(N));
+    }
+
+    // ---------------------------------------------------------- //
+    // Collapse and solve the local nodes on their CFGs, then fill
+    // in the coarse live out at the nodes reaching the exits
+    // ---------------------------------------------------------- //
+    std::vector<bool> IsIdentity(NumLocal, false);
+    if (!NoCollapse) {
+        for (unsigned L = 0; L != NumLocal; ++L) {
+            IsIdentity[L] = IsCAPArrayEmpty(LocalGen[L]);
+        }
+    }
+
+    std::vector<unsigned> LocalSuper;
+    std::vector<unsigned> SuperLocal;
+    CSRGraph SuperSuccs;
+    CSRGraph SuperPreds;
+    unsigned NumLocalSuper = CollapseIdentityNodes(LocalSuccs, IsIdentity,
+                                                   LocalSuper, SuperLocal,
+                                                   SuperSuccs);
+    SuperPreds.buildReverse(SuperSuccs);
+    std::vector<bool>().swap(IsIdentity);
+
+    BBCAPTable_t SuperLive_in(NumLocalSuper, 0);
+    BBCAPTable_t SuperGen(NumLocalSuper);
+    std::vector<unsigned> SuperOrder(NumLocalSuper);
+    for (unsigned S = 0; S != NumLocalSuper; ++S) {
+        SuperGen[S] = LocalGen[SuperLocal[S]];
+        SuperOrder[S] = SuperLocal[S];
+    }
+    BBCAPTable_t().swap(LocalGen);
+
+    SolveLive(SuperSuccs, SuperPreds, SuperOrder, SuperGen.data(),
+              SuperLive_in.data());
+    NumSolvedNodes += NumLocalSuper;
+
+    std::vector<bool> ReachExit(NumLocalSuper, false);
+    std::vector<unsigned> Worklist;
+    for (unsigned FID = 0; FID != NumFuncs; ++FID) {
+        if (!FuncRefined[FID] || Graph.ExitBB[FID] == INVALID_ID) { continue; }
+
+        unsigned S = LocalSuper[LocalID[Graph.ExitBB[FID]]];
+        ReachExit[S] = true;
+        Worklist.push_back(S);
+    }
+
+    while (!Worklist.empty()) {
+        unsigned S = Worklist.back();
+        Worklist.pop_back();
+
+        for (const unsigned *PI = SuperPreds.succ_begin(S),
+                 *PE = SuperPreds.succ_end(S); PI != PE; ++PI) {
+            if (!ReachExit[*PI]) {
+                ReachExit[*PI] = true;
+                Worklist.push_back(*PI);
+            }
+        }
+    }
+
+    for (unsigned S = 0; S != NumLocalSuper; ++S) {
+        if (ReachExit[S]) {
+            unsigned FID = Graph.BBFunc[LocalNode[SuperLocal[S]]];
+            UnionCAPArrays(SuperLive_in[S], FuncLiveCAPTable_out[FID]);
+        }
+    }
+
+    // ---------------------------------------------------------- //
+    // Super-nodes of all nodes: the local super-nodes first, then
+    // one for the BBs of each other function, with the coarse live
+    // in, and one for each of its return BBs, with the coarse live
+    // out. Virtual exits of the other functions are not BBs, and
+    // share the super-node of their function.
+    // ---------------------------------------------------------- //
+    SuperNodeBB.resize(NumLocalSuper);
+    SuperCAPTable_in.resize(NumLocalSuper);
+    SuperCAPTable_out.assign(NumLocalSuper, CAPSET_EMPTY);
+
+    for (unsigned S = 0; S != NumLocalSuper; ++S) {
+        SuperNodeBB[S] = LocalNode[SuperLocal[S]];
+        SuperCAPTable_in[S] = CAPSets.intern(SuperLive_in[S]);
+    }
+    BBCAPTable_t().swap(SuperLive_in);
+    BBCAPTable_t().swap(SuperGen);
+
+    for (unsigned S = 0; S != NumLocalSuper; ++S) {
+        CAPSetID_t &Out = SuperCAPTable_out[S];
+        for (const unsigned *SI = SuperSuccs.succ_begin(S),
+                 *SE = SuperSuccs.succ_end(S); SI != SE; ++SI) {
+            Out = CAPSets.unionSets(Out, SuperCAPTable_in[*SI]);
+        }
+    }
+
+    std::vector<unsigned> FuncSuperNode(NumFuncs, INVALID_ID);
+    for (unsigned FID = 0; FID != NumFuncs; ++FID) {
+        if (FuncRefined[FID]) {
+            unsigned Exit = Graph.ExitBB[FID];
+            if (Exit != INVALID_ID) {
+                CAPSetID_t &Out = SuperCAPTable_out[LocalSuper[LocalID[Exit]]];
+                Out = CAPSets.unionSets(Out,
+                                        CAPSets.intern(FuncLiveCAPTable_out[FID]));
+            }
+            continue;
+        }
+
+        if (Graph.EntryBB[FID] == INVALID_ID) { continue; }
+
+        CAPSetID_t In = CAPSets.intern(FuncLiveCAPTable_in[FID]);
+        FuncSuperNode[FID] = SuperNodeBB.size();
+        SuperNodeBB.push_back(Graph.EntryBB[FID]);
+        SuperCAPTable_in.push_back(In);
+        SuperCAPTable_out.push_back(In);
+    }
+
+    BBSuperNode.assign(NumNodes, INVALID_ID);
+    BBCAPTable_dropEnd.assign(NumBBs, CAPSET_EMPTY);
+    BBCAPTable_dropStart.assign(NumBBs, CAPSET_EMPTY);
+
+    for (unsigned N = 0; N != NumNodes; ++N) {
+        if (LocalID[N] != INVALID_ID) {
+            BBSuperNode[N] = LocalSuper[LocalID[N]];
+            continue;
+        }
+
+        unsigned FID = Graph.BBFunc[N];
+        BBSuperNode[N] = FuncSuperNode[FID];
+
+        // a return BB drops what's not live after the function returns
+        if (N < NumBBs && (Graph.ExitBB[FID] == N ||
+                           Graph.getVirtualExitOf(N) != INVALID_ID)) {
+            CAPSetID_t In = SuperCAPTable_in[FuncSuperNode[FID]];
+            CAPSetID_t Out = CAPSets.intern(FuncLiveCAPTable_out[FID]);
+
+            BBSuperNode[N] = SuperNodeBB.size();
+            SuperNodeBB.push_back(N);
+            SuperCAPTable_in.push_back(In);
+            SuperCAPTable_out.push_back(Out);
+            BBCAPTable_dropEnd[N] = CAPSets.diffSets(In, Out);
+        }
+    }
+
+    // ---------------------------------------------------------- //
+    // Drops of the BBs refined, the BBs of the other functions all
+    // have the same live in, so only return BBs drop
+    // ---------------------------------------------------------- //
+    for (unsigned L = 0; L != NumLocal; ++L) {
+        unsigned BID = LocalNode[L];
+        if (Graph.isVirtualExit(BID)) { continue; }
+
+        CAPSetID_t Out = getLiveOut(BID);
+        BBCAPTable_dropEnd[BID] = CAPSets.diffSets(getLiveIn(BID), Out);
+
+        const unsigned *SI = LocalSuccs.succ_begin(L);
+        for (const unsigned *SE = SI + NumLocalCFGSuccs[L]; SI != SE; ++SI) {
+            unsigned Succ = LocalNode[*SI];
+            CAPSetID_t Drop = CAPSets.diffSets(Out, getLiveIn(Succ));
+
+            BBCAPTable_dropStart[Succ] = CAPSets.unionSets(BBCAPTable_dropStart[Succ],
+                                                           Drop);
+        }
+    }
+}
+
+
+// get the IDs of the unique live in sets of all BBs
+// The sets are interned already, so only the IDs are collected
+// param: UniqueSets - the IDs of the sets to save to
+void GlobalLiveAnalysis::findUniqueSet(std::vector<CAPSetID_t> &UniqueSets) const
+{
+    std::vector<bool> IsLiveIn(CAPSets.getNumSets(), false);
+
+    // virtual exit nodes are not BBs
+    for (unsigned BID = 0, BE = Graph.getNumBBs(); BID != BE; ++BID) {
+        IsLiveIn[getLiveIn(BID)] = true;
+    }
+
+    UniqueSets.clear();
+    for (unsigned ID = 0, E = IsLiveIn.size(); ID != E; ++ID) {
+        if (IsLiveIn[ID]) { UniqueSets.push_back(ID); }
+    }
 }
 
 
 // Print out information for debugging purposes
+// The unique live in sets are printed from the most CAPs
 void GlobalLiveAnalysis::print(raw_ostream &O, const Module *M) const
 {
     errs() << "Dumping information for unique capability set.\n\n";
 
-    std::vector<std::pair<CAPArray_t, int> >Setcopy(CAPSet.begin(), CAPSet.end());
+    std::vector<CAPSetID_t> UniqueSets;
+    findUniqueSet(UniqueSets);
 
-    std::sort(Setcopy.begin(), Setcopy.end(), compareSet);
+    const std::vector<CAPArray_t> &Sets = CAPSets.getSets();
+    std::vector<unsigned> Counts(Sets.size());
+    PopcountCAPTable(Counts.data(), Sets.data(), Sets.size());
+
+    std::stable_sort(UniqueSets.begin(), UniqueSets.end(),
+                     [&](CAPSetID_t A, CAPSetID_t B) {
+                         return Counts[A] > Counts[B];
+                     });
     
     int line = 0;
 
     // dump the uniq set of capabilities
-    for (auto BI = Setcopy.begin(), BE = Setcopy.end(); BI != BE; ++BI) {
+    for (auto SI = UniqueSets.begin(), SE = UniqueSets.end(); SI != SE; ++SI) {
         O << line++ << ": ";
 
-        dumpCAPArray(O, BI->first);
+        dumpCAPArray(O, Sets[*SI]);
     }
 }
 
@@ -300,7 +869,9 @@ void GlobalLiveAnalysis::print(raw_ostream &O, const Module *M) const
 // Dump BBCAPTable for Debugging purpose
 void GlobalLiveAnalysis::dumpTable()
 {
-    errs() << "BBCAPTable_in size " << BBCAPTable_in.size() << "\n";
+    const ModuleNumbering &Numbering = getAnalysis<SplitBB>().Numbering;
+
+    errs() << "BBCAPTable_in size " << Graph.getNumBBs() << "\n";
 
     ////////////////////////////////////////
     // DEBUG
@@ -308,17 +879,16 @@ void GlobalLiveAnalysis::dumpTable()
     errs() << "BBCAPTable size " << BBCAPTable_dropEnd.size() << "\n";
     // Dump in and out for each BB
     int count = 0;
-    for (auto bi = BBCAPTable_in.begin(); 
-         bi != BBCAPTable_in.end(); ++bi) {
-        BasicBlock *B = bi->first;
-        CAPArray_t &CAPArray_in = bi->second;
-        CAPArray_t &CAPArray_out = BBCAPTable_out[B];
+    for (unsigned BID = 0, BE = Graph.getNumBBs(); BID != BE; ++BID) {
+        BasicBlock *B = Numbering.getBB(BID);
+        const CAPArray_t &CAPArray_in = CAPSets.getSet(getLiveIn(BID));
+        const CAPArray_t &CAPArray_out = CAPSets.getSet(getLiveOut(BID));
         ++count;
         // In 
         errs() << "BB" << count
                << " in " << B->getParent()->getName() << ":  \t";
         for (int i = 0; i < CAP_TOTALNUM; ++i) {
-            if (CAPArray_in & ((uint64_t) 1 << i)){
+            if (HasCAP(CAPArray_in, i)) {
                 errs() << i << "\t";
             }
         }
@@ -327,7 +897,7 @@ void GlobalLiveAnalysis::dumpTable()
                << " out " << B->getParent()->getName() << ":  \t";
         // Out
         for (unsigned int i = 0; i < CAP_TOTALNUM; ++i) {
-            if(CAPArray_out & ((uint64_t) 1 << i)){
+            if (HasCAP(CAPArray_out, i)) {
                 errs() << i << "\t";
             }
         }
@@ -336,15 +906,16 @@ void GlobalLiveAnalysis::dumpTable()
     errs() << "\n";
 
     // Dump the drop for each BB
-    for (auto bi = BBCAPTable_dropEnd.begin(); 
-         bi != BBCAPTable_dropEnd.end(); ++bi) {
-        BasicBlock *B = bi->first;
-        CAPArray_t &CAPArray_drop = bi->second;
+    for (unsigned BID = 0, BE = BBCAPTable_dropEnd.size(); BID != BE; ++BID) {
+        const CAPArray_t &CAPArray_drop = CAPSets.getSet(BBCAPTable_dropEnd[BID]);
+        if (IsCAPArrayEmpty(CAPArray_drop)) { continue; }
+
+        BasicBlock *B = Numbering.getBB(BID);
         ++count;
         errs() << "BB" << count
                << " drop End " << B->getParent()->getName() << ":  \t";
         for (int i = 0; i < CAP_TOTALNUM; ++i) {
-            if (CAPArray_drop & ((uint64_t) 1 << i)){
+            if (HasCAP(CAPArray_drop, i)) {
                 errs() << i << "\t";
             }
         }
@@ -352,15 +923,16 @@ void GlobalLiveAnalysis::dumpTable()
     }
     errs() << "\n";
 
-    for (auto bi = BBCAPTable_dropStart.begin(); 
-         bi != BBCAPTable_dropStart.end(); ++bi) {
-        BasicBlock *B = bi->first;
-        CAPArray_t &CAPArray_drop = bi->second;
+    for (unsigned BID = 0, BE = BBCAPTable_dropStart.size(); BID != BE; ++BID) {
+        const CAPArray_t &CAPArray_drop = CAPSets.getSet(BBCAPTable_dropStart[BID]);
+        if (IsCAPArrayEmpty(CAPArray_drop)) { continue; }
+
+        BasicBlock *B = Numbering.getBB(BID);
         ++count;
         errs() << "BB" << count
                << " drop Start " << B->getParent()->getName() << ":  \t";
         for (unsigned int i = 0; i < CAP_TOTALNUM; ++i) {
-            if(CAPArray_drop & ((uint64_t) 1 << i)){
+            if (HasCAP(CAPArray_drop, i)) {
                 errs() << i << "\t";
             }
         }
@@ -18,8 +18,10 @@
 
 #include "ADT.h"
 #include "SplitBB.h"
+#include "ICFG.h"
 
 #include <map>
+#include <vector>
 
 using namespace llvm::privAnalysis;
 
@@ -31,19 +33,33 @@ struct GlobalLiveAnalysis : public ModulePass
 public:
     static char ID;
 
-    // Data structures to save data
-    BBCAPTable_t BBCAPTable_in;
-    BBCAPTable_t BBCAPTable_out;
-    BBCAPTable_t BBCAPTable_dropEnd;
-    BBCAPTable_t BBCAPTable_dropStart;
+    // BBs with the same live in are collapsed into super-nodes
+    // before solving. The live tables are saved for each super-node,
+    // and expanded to BBs by getLiveIn and getLiveOut.
+    // Super-node ID of each BB ID from SplitBB
+    std::vector<unsigned> BBSuperNode;
+    // Representative BB of each super-node, the only BB of the
+    // super-node with ICFG edges out of it
+    std::vector<unsigned> SuperNodeBB;
+    // Live in and live out of the representative BB of each super-node
+    BBCAPSetTable_t SuperCAPTable_in;
+    BBCAPSetTable_t SuperCAPTable_out;
+
+    // Data structures to save data, indexed by the IDs from SplitBB
+    // Each BB saves the IDs of its sets in CAPSets, drop tables are
+    // CAPSET_EMPTY for BBs with nothing to drop
+    BBCAPSetTable_t BBCAPTable_dropEnd;
+    BBCAPSetTable_t BBCAPTable_dropStart;
+    // Live in at the entry and live out at the exit of each function
     FuncCAPTable_t FuncLiveCAPTable_in;
     FuncCAPTable_t FuncLiveCAPTable_out;
 
-    // Record exit BB of 
-    typedef std::map<Function*, BasicBlock*> FuncReturnBB_t;
+    // The unique capability sets of all BB tables
+    CAPSetTable CAPSets;
 
-    // The unique capability set
-    CAPSet_t CAPSet;
+    // The ICFG of all BBs the analysis runs on, only the call edges
+    // in the coarse mode
+    ICFG Graph;
 
     GlobalLiveAnalysis();
 
@@ -59,12 +75,41 @@ public:
     // Print out information for debugging purposes
     void print(raw_ostream &O, const Module *M) const;
 
-private:
-    // find exit BB of functions inside a Module
-    void findReturnBB(Module& M, FuncReturnBB_t&);
+    // get the IDs of the unique live in sets of all BBs
+    void findUniqueSet(std::vector<CAPSetID_t> &UniqueSets) const;
+
+    // Live in of the BB, the ID of the set in CAPSets
+    CAPSetID_t getLiveIn(unsigned BID) const
+    { return SuperCAPTable_in[BBSuperNode[BID]]; }
 
-    // get the unique privilege set 
-    void findUniqueSet();
+    // Live out of the BB, the BBs collapsed into a super-node other
+    // than the representative have no gen, so live out is live in
+    CAPSetID_t getLiveOut(unsigned BID) const
+    {
+        unsigned S = BBSuperNode[BID];
+        return SuperNodeBB[S] == BID ? SuperCAPTable_out[S] : SuperCAPTable_in[S];
+    }
+
+private:
+    // Solve the coarse live in and live out of each function
+    void findCoarseLive(const FuncCAPTable_t &FuncUse,
+                        const std::vector<bool> &InSlice,
+                        std::vector<bool> &FuncRefined);
+
+    // Solve the live analysis in the coarse mode
+    void solveCoarse(const FuncCAPTable_t &FuncUse,
+                     const BBCAPTable_t &BBCAPTable,
+                     const std::vector<bool> &InSlice);
+
+    // Apply the summaries of functions to the live in solved on CFGs
+    void applySummaries(const CSRGraph &SuperPreds, BBCAPTable_t &SuperLive,
+                        FuncCAPTable_t &FuncLive_exit);
+
+    // Solve the live at the exit of each function on the call graph
+    void solveFuncExits(const BBCAPTable_t &SuperLive,
+                        const std::vector<bool> &ReachExit,
+                        const std::vector<unsigned> &SuperFunc,
+                        FuncCAPTable_t &FuncLive_exit);
 
     void dumpTable();
 };
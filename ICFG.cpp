@@ -0,0 +1,320 @@
+// ====--------------------  ICFG.cpp -----------*- C++ -*---====
+//
+// The interprocedural control flow graph over BB IDs, built once
+// in compressed sparse row form for the dataflow solvers.
+//
+// ====-------------------------------------------------------====
+
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+
+#include "ICFG.h"
+#include "Dataflow.h"
+
+#include <algorithm>
+
+using namespace llvm;
+using namespace llvm::privAnalysis;
+
+
+// Find the exit node of each function in the slice
+// A function with only one return BB exits from the last segment of
+// it. The return BBs of a function with more than one are merged in
+// a virtual exit node, numbered after all BBs. BBs ending with
+// unreachable or resume do not return to the call sites.
+// param: Numbering - the numbering of functions and BBs
+//        FuncInSlice - if each function ID is in the slice
+//        VirtualExitOf - the virtual exit node of each BB to save to,
+//                        INVALID_ID if it's not a return BB merged
+// return: the number of nodes, BBs and virtual exit nodes
+unsigned ICFG::findExits(const ModuleNumbering &Numbering,
+                         const std::vector<bool> &FuncInSlice,
+                         std::vector<unsigned> &VirtualExitOf)
+{
+    unsigned NumFuncs = Numbering.getNumFuncs();
+    unsigned NumNodes = NumBBs;
+    std::vector<unsigned> Returns;
+
+    ExitBB.assign(NumFuncs, INVALID_ID);
+    VirtualExitOf.assign(NumBBs, INVALID_ID);
+
+    for (unsigned FID = 0; FID != NumFuncs; ++FID) {
+        Function *F = Numbering.getFunc(FID);
+        if (F == NULL || F->empty() || !FuncInSlice[FID]) { continue; }
+
+        Returns.clear();
+        for (Function::iterator BI = F->begin(), BE = F->end(); BI != BE; ++BI) {
+            if (isa<ReturnInst>(BI->getTerminator())) {
+                Returns.push_back(Numbering.getLastSegmentID(&*BI));
+            }
+        }
+
+        if (Returns.empty()) { continue; }
+
+        if (Returns.size() == 1) {
+            ExitBB[FID] = Returns.front();
+            continue;
+        }
+
+        ExitBB[FID] = NumNodes;
+        for (auto RI = Returns.begin(), RE = Returns.end(); RI != RE; ++RI) {
+            VirtualExitOf[*RI] = NumNodes;
+        }
+        ++NumNodes;
+    }
+
+    return NumNodes;
+}
+
+
+// Find the function and the callees of all numbered BBs, or segments
+// of BBs, and the entry and the exit of all functions, without the
+// edges of the ICFG
+// param: Numbering - the numbering of functions and BBs
+//        BBFuncTable - the direct callee of call BBs
+//        UnsplitCalls - calls not split on, sorted by BB IDs
+//        callTargetIndex - the DSA resolved callees of call instructions
+//        FuncInSlice - if each function ID is in the slice
+void ICFG::buildCalls(const ModuleNumbering &Numbering,
+                      const BBFuncTable_t &BBFuncTable,
+                      const BBCallList_t &UnsplitCalls,
+                      const CallTargetIndex &callTargetIndex,
+                      const std::vector<bool> &FuncInSlice)
+{
+    NumBBs = Numbering.getNumBBs();
+    unsigned NumFuncs = Numbering.getNumFuncs();
+
+    // the edges are only built by build
+    Succs = CSRGraph();
+    Preds = CSRGraph();
+    NumCFGSuccs.clear();
+    NumIntraSuccs.clear();
+
+    unsigned NumNodes = findExits(Numbering, FuncInSlice, VirtualExitOf);
+
+    EntryBB.assign(NumFuncs, INVALID_ID);
+    for (unsigned FID = 0; FID != NumFuncs; ++FID) {
+        Function *F = Numbering.getFunc(FID);
+        if (F != NULL && !F->empty()) {
+            EntryBB[FID] = Numbering.getBBID(&F->getEntryBlock());
+        }
+    }
+
+    // ---------------------------------------------------------- //
+    // Call targets, appended in the order of BB IDs
+    // ---------------------------------------------------------- //
+    CallTargets.Offsets.assign(1, 0);
+    CallTargets.Targets.clear();
+    auto UI = UnsplitCalls.begin(), UE = UnsplitCalls.end();
+
+    // Indirect calls are not split on, so the callees resolved by DSA
+    // are the callees of the BBs, or segments, the calls are in
+    BBCallList_t ResolvedCalls;
+    for (unsigned CID = 0, CE = callTargetIndex.getNumCalls(); CID != CE; ++CID) {
+        unsigned BID = Numbering.getSegmentID(callTargetIndex.getCall(CID));
+        ArrayRef<Function *> Resolved = callTargetIndex.getTargets(CID);
+
+        for (auto FI = Resolved.begin(), FE = Resolved.end(); FI != FE; ++FI) {
+            ResolvedCalls.push_back(std::make_pair(BID, Numbering.getFuncID(*FI)));
+        }
+    }
+    std::sort(ResolvedCalls.begin(), ResolvedCalls.end());
+    auto RI = ResolvedCalls.begin(), RE = ResolvedCalls.end();
+
+    BBFunc.assign(NumNodes, INVALID_ID);
+    const Function *LastFunc = NULL;
+    unsigned LastFID = INVALID_ID;
+
+    for (unsigned BID = 0; BID != NumBBs; ++BID) {
+        // BBs of a function are mostly numbered together
+        const Function *F = Numbering.getBB(BID)->getParent();
+        if (F != LastFunc) {
+            LastFunc = F;
+            LastFID = Numbering.getFuncID(F);
+        }
+        BBFunc[BID] = LastFID;
+
+        bool InSlice = FuncInSlice[LastFID];
+
+        if (InSlice && BID < BBFuncTable.size() && BBFuncTable[BID] != NULL) {
+            CallTargets.Targets.push_back(Numbering.getFuncID(BBFuncTable[BID]));
+        }
+
+        for (; UI != UE && UI->first == BID; ++UI) {
+            if (InSlice) { CallTargets.Targets.push_back(UI->second); }
+        }
+
+        for (; RI != RE && RI->first == BID; ++RI) {
+            if (InSlice) { CallTargets.Targets.push_back(RI->second); }
+        }
+        CallTargets.Offsets.push_back(CallTargets.Targets.size());
+    }
+
+    // virtual exit nodes have no calls
+    for (unsigned FID = 0; FID != NumFuncs; ++FID) {
+        if (ExitBB[FID] != INVALID_ID && isVirtualExit(ExitBB[FID])) {
+            BBFunc[ExitBB[FID]] = FID;
+        }
+    }
+    CallTargets.Offsets.resize(NumNodes + 1, CallTargets.Targets.size());
+}
+
+
+// Append the successors of a node in the same function, the CFG
+// successors first, then the virtual exit node
+// param: Numbering - the numbering of functions and BBs
+//        N - the node
+//        Targets - the successors to append to
+// return: the number of CFG successors appended
+unsigned ICFG::appendIntraSuccs(const ModuleNumbering &Numbering, unsigned N,
+                                std::vector<unsigned> &Targets) const
+{
+    // virtual exit nodes have no CFG edges
+    if (isVirtualExit(N)) { return 0; }
+
+    unsigned Begin = Targets.size();
+
+    // a segment falls through to the next segment of the same BB
+    if (!Numbering.isLastSegment(N)) {
+        Targets.push_back(N + 1);
+    }
+    else {
+        const TerminatorInst *BBTerm = Numbering.getBB(N)->getTerminator();
+
+        for (unsigned BSI = 0, BSE = BBTerm->getNumSuccessors();
+             BSI != BSE; ++BSI) {
+            Targets.push_back(Numbering.getBBID(BBTerm->getSuccessor(BSI)));
+        }
+    }
+
+    unsigned NumCFG = Targets.size() - Begin;
+
+    if (VirtualExitOf[N] != INVALID_ID) {
+        Targets.push_back(VirtualExitOf[N]);
+    }
+
+    return NumCFG;
+}
+
+
+// Build the ICFG of all numbered BBs, or segments of BBs
+// param: Numbering - the numbering of functions and BBs
+//        BBFuncTable - the direct callee of call BBs
+//        UnsplitCalls - calls not split on, sorted by BB IDs
+//        callTargetIndex - the DSA resolved callees of call instructions
+//        FuncInSlice - if each function ID is in the slice
+void ICFG::build(const ModuleNumbering &Numbering,
+                 const BBFuncTable_t &BBFuncTable,
+                 const BBCallList_t &UnsplitCalls,
+                 const CallTargetIndex &callTargetIndex,
+                 const std::vector<bool> &FuncInSlice)
+{
+    buildCalls(Numbering, BBFuncTable, UnsplitCalls, callTargetIndex,
+               FuncInSlice);
+    unsigned NumNodes = BBFunc.size();
+
+    // ---------------------------------------------------------- //
+    // Call BBs of each exit node, by reversing call BB -> exit node
+    // ---------------------------------------------------------- //
+    CSRGraph CallToExit;
+    CallToExit.Offsets.assign(1, 0);
+
+    for (unsigned BID = 0; BID != NumNodes; ++BID) {
+        for (const unsigned *CI = CallTargets.succ_begin(BID),
+                 *CE = CallTargets.succ_end(BID); CI != CE; ++CI) {
+            if (ExitBB[*CI] != INVALID_ID) {
+                CallToExit.Targets.push_back(ExitBB[*CI]);
+            }
+        }
+        CallToExit.Offsets.push_back(CallToExit.Targets.size());
+    }
+
+    CSRGraph ExitToCall;
+    ExitToCall.buildReverse(CallToExit);
+
+    // ---------------------------------------------------------- //
+    // CFG edges and return BB -> virtual exit edges, appended in the
+    // order of node IDs
+    // ---------------------------------------------------------- //
+    CSRGraph Intra;
+    Intra.Offsets.assign(1, 0);
+    NumCFGSuccs.assign(NumNodes, 0);
+    NumIntraSuccs.assign(NumNodes, 0);
+
+    for (unsigned BID = 0; BID != NumNodes; ++BID) {
+        NumCFGSuccs[BID] = appendIntraSuccs(Numbering, BID, Intra.Targets);
+        Intra.Offsets.push_back(Intra.Targets.size());
+        NumIntraSuccs[BID] = Intra.succ_end(BID) - Intra.succ_begin(BID);
+    }
+
+    // ---------------------------------------------------------- //
+    // Merge the edges in functions and exit -> return site edges
+    // ---------------------------------------------------------- //
+    Succs.Offsets.assign(1, 0);
+    Succs.Targets.clear();
+
+    for (unsigned BID = 0; BID != NumNodes; ++BID) {
+        Succs.Targets.insert(Succs.Targets.end(),
+                             Intra.succ_begin(BID), Intra.succ_end(BID));
+
+        for (const unsigned *CI = ExitToCall.succ_begin(BID),
+                 *CE = ExitToCall.succ_end(BID); CI != CE; ++CI) {
+            Succs.Targets.insert(Succs.Targets.end(), Intra.succ_begin(*CI),
+                                 Intra.succ_begin(*CI) + NumCFGSuccs[*CI]);
+        }
+        Succs.Offsets.push_back(Succs.Targets.size());
+    }
+
+    Preds.buildReverse(Succs);
+}
+
+
+// Solve the coarse live out of each function on the call graph
+// What a caller uses anywhere may be live when a callee returns to it:
+//   out[F] = use[C] | out[C] for callers C of F with an exit
+// which is safe for the exit of F, as the return sites are in C.
+// param: FuncUse - the CAPs used by each function and its callees
+//        FuncLive_out - the live out of each function to save to
+void ICFG::findCoarseLiveOut(const FuncCAPTable_t &FuncUse,
+                             FuncCAPTable_t &FuncLive_out) const
+{
+    unsigned NumFuncs = ExitBB.size();
+
+    FuncCAPTable_t RetGen(NumFuncs, 0);
+    AdjList_t CallerAdj(NumFuncs);
+
+    for (unsigned BID = 0; BID != NumBBs; ++BID) {
+        unsigned Caller = BBFunc[BID];
+        bool CallerExit = ExitBB[Caller] != INVALID_ID;
+
+        for (const unsigned *CI = CallTargets.succ_begin(BID),
+                 *CE = CallTargets.succ_end(BID); CI != CE; ++CI) {
+            if (ExitBB[*CI] == INVALID_ID) { continue; }
+
+            UnionCAPArrays(RetGen[*CI], FuncUse[Caller]);
+            if (CallerExit) { CallerAdj[Caller].push_back(*CI); }
+        }
+    }
+
+    for (auto AI = CallerAdj.begin(), AE = CallerAdj.end(); AI != AE; ++AI) {
+        std::sort(AI->begin(), AI->end());
+        AI->erase(std::unique(AI->begin(), AI->end()), AI->end());
+    }
+
+    CSRGraph CallerSuccs;
+    CSRGraph CallerPreds;
+    CallerSuccs.build(CallerAdj);
+    CallerPreds.buildReverse(CallerSuccs);
+    AdjList_t().swap(CallerAdj);
+
+    // callers are visited before callees in the order of function IDs
+    std::vector<unsigned> FuncOrder(NumFuncs);
+    for (unsigned FID = 0; FID != NumFuncs; ++FID) {
+        FuncOrder[FID] = NumFuncs - FID;
+    }
+
+    FuncLive_out.assign(NumFuncs, 0);
+    SolveDataflow<DATAFLOW_FORWARD>(CallerSuccs, CallerPreds, FuncOrder,
+                                    RetGen.data(), FuncLive_out.data());
+}
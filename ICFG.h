@@ -0,0 +1,126 @@
+// ====---------------------  ICFG.h ------------*- C++ -*---====
+//
+// The interprocedural control flow graph over BB IDs, built once
+// in compressed sparse row form for the dataflow solvers.
+//
+// Edges of the ICFG:
+// 1. CFG edges from BBs to their successors in the same function
+// 2. Edges from the return BBs of a function with more than one
+//    to its virtual exit node, numbered after all BBs. The IR is
+//    not changed, unlike by UnifyFunctionExitNodes.
+// 3. Edges from the exit of callees, the only return BB or the
+//    virtual exit node, to the return sites of all their call
+//    sites, i.e. the successors of the call BBs
+// Call edges from call BBs to the callees, including the DSA
+// resolved callees and the callees of calls not split on, are
+// saved separately in CallTargets. BBs of functions not in the
+// slice have no call edges. buildCalls only builds the call edges,
+// for analyses building the edges of some functions on their own.
+//
+// ====-------------------------------------------------------====
+
+#ifndef __ICFG_H__
+#define __ICFG_H__
+
+#include "llvm/IR/Module.h"
+
+#include "ADT.h"
+
+#include <vector>
+
+namespace llvm {
+namespace privAnalysis {
+
+struct ICFG
+{
+public:
+    // Successors of each node, CFG successors come first, then the
+    // virtual exit node, then the return sites
+    CSRGraph Succs;
+
+    // Predecessors of each node
+    CSRGraph Preds;
+
+    // The number of CFG successors of each node
+    std::vector<unsigned> NumCFGSuccs;
+
+    // The number of successors in the same function of each node,
+    // the CFG successors and the virtual exit node
+    std::vector<unsigned> NumIntraSuccs;
+
+    // Callee function IDs of each node, direct and DSA resolved
+    CSRGraph CallTargets;
+
+    // Function ID of each node
+    std::vector<unsigned> BBFunc;
+
+    // Entry BB ID of each function ID, INVALID_ID if empty
+    std::vector<unsigned> EntryBB;
+
+    // Exit node ID of each function ID in the slice, INVALID_ID if
+    // it never returns
+    std::vector<unsigned> ExitBB;
+
+    // Build the ICFG of all numbered BBs
+    void build(const ModuleNumbering &Numbering,
+               const BBFuncTable_t &BBFuncTable,
+               const BBCallList_t &UnsplitCalls,
+               const CallTargetIndex &callTargetIndex,
+               const std::vector<bool> &FuncInSlice);
+
+    // Find the function and the callees of all numbered BBs, and
+    // the entry and the exit of all functions, without the edges
+    void buildCalls(const ModuleNumbering &Numbering,
+                    const BBFuncTable_t &BBFuncTable,
+                    const BBCallList_t &UnsplitCalls,
+                    const CallTargetIndex &callTargetIndex,
+                    const std::vector<bool> &FuncInSlice);
+
+    // Append the successors of the node in the same function,
+    // only needs buildCalls
+    unsigned appendIntraSuccs(const ModuleNumbering &Numbering, unsigned N,
+                              std::vector<unsigned> &Targets) const;
+
+    // The number of BBs, nodes of virtual exits are after them
+    unsigned getNumBBs() const { return NumBBs; }
+
+    unsigned getNumNodes() const { return BBFunc.size(); }
+
+    bool isVirtualExit(unsigned N) const { return N >= NumBBs; }
+
+    // The virtual exit node of a return BB, INVALID_ID if it's not
+    // a return BB merged
+    unsigned getVirtualExitOf(unsigned B) const { return VirtualExitOf[B]; }
+
+    // Iterate the CFG successors only
+    const unsigned *cfg_succ_begin(unsigned B) const
+    { return Succs.succ_begin(B); }
+
+    const unsigned *cfg_succ_end(unsigned B) const
+    { return Succs.succ_begin(B) + NumCFGSuccs[B]; }
+
+    // Iterate the successors in the same function only
+    const unsigned *intra_succ_end(unsigned B) const
+    { return Succs.succ_begin(B) + NumIntraSuccs[B]; }
+
+    // Solve the coarse live out of each function on the call graph
+    void findCoarseLiveOut(const FuncCAPTable_t &FuncUse,
+                           FuncCAPTable_t &FuncLive_out) const;
+
+private:
+    unsigned NumBBs;
+
+    // The virtual exit node of each return BB, INVALID_ID if it's
+    // not a return BB merged
+    std::vector<unsigned> VirtualExitOf;
+
+    // Find the exit node of each function in the slice
+    unsigned findExits(const ModuleNumbering &Numbering,
+                       const std::vector<bool> &FuncInSlice,
+                       std::vector<unsigned> &VirtualExitOf);
+};
+
+} // namespace privAnalysis
+} // namespace llvm
+
+#endif
@@ -0,0 +1,417 @@
+// ====-----------------  LiveQuery.cpp ---------*- C++ -*---====
+//
+// Demand-driven queries of the privilege live analysis. The live
+// CAPs of a mask are answered for a single instruction or BB by
+// searching the ICFG forward from it, without solving the live
+// analysis of the whole module.
+//
+// ====-------------------------------------------------------====
+
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/Support/CommandLine.h"
+
+#include "LiveQuery.h"
+#include "SplitBB.h"
+#include "LocalAnalysis.h"
+#include "PropagateAnalysis.h"
+#include "DSAExternAnalysis.h"
+#include "PrivCallGraph.h"
+#include "CAPKernels.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+
+using namespace llvm;
+using namespace llvm::splitBB;
+using namespace llvm::localAnalysis;
+using namespace llvm::propagateAnalysis;
+using namespace llvm::dsaexterntarget;
+using namespace llvm::privCallGraph;
+using namespace llvm::liveQuery;
+
+
+static cl::opt<std::string> QueryFunc("priv-query-func",
+    cl::desc("Function to find where the queried CAPs are last live in"),
+    cl::value_desc("function"), cl::init("main"));
+
+static cl::list<std::string> QueryCAPs("priv-query-caps",
+    cl::desc("CAPs to query, by name or number, all CAPs if not given"),
+    cl::value_desc("CAP,..."), cl::CommaSeparated);
+
+static cl::opt<std::string> QueryCall("priv-query-call",
+    cl::desc("Query the live CAPs after each call to the function"),
+    cl::value_desc("function"), cl::init(""));
+
+
+// Find a capability by its name or number
+// param: Name - the name, case insensitive, or the number
+// return: the capability, or INVALID_ID if unknown
+static unsigned findCAPByName(StringRef Name)
+{
+    unsigned CAP;
+    if (!Name.getAsInteger(10, CAP)) {
+        return CAP < CAP_TOTALNUM ? CAP : INVALID_ID;
+    }
+
+    for (CAP = 0; CAP != CAP_TOTALNUM; ++CAP) {
+        if (Name.equals_lower(getCAPName(CAP))) { return CAP; }
+    }
+
+    return INVALID_ID;
+}
+
+
+// The function called by a call or invoke, NULL if indirect
+static const Function *getCalledFunc(const Instruction *I)
+{
+    if (const CallInst *CI = dyn_cast<CallInst>(I)) {
+        return CI->getCalledFunction();
+    }
+    if (const InvokeInst *II = dyn_cast<InvokeInst>(I)) {
+        return II->getCalledFunction();
+    }
+    return NULL;
+}
+
+
+// PrivLiveQuery constructor
+PrivLiveQuery::PrivLiveQuery() : ModulePass(ID), Search(0) { }
+
+
+// Require Analysis usage
+void PrivLiveQuery::getAnalysisUsage(AnalysisUsage &AU) const
+{
+    AU.setPreservesAll();
+
+    AU.addRequired<DSAExternAnalysis>();
+    AU.addRequired<LocalAnalysis>();
+    AU.addRequired<PropagateAnalysis>();
+    AU.addRequired<PrivCallGraph>();
+    AU.addRequired<SplitBB>();
+}
+
+
+// Do initialization
+bool PrivLiveQuery::doInitialization(Module &M)
+{
+    return false;
+}
+
+
+// Build the ICFG and the coarse live in of functions for the
+// queries, nothing is solved on BBs until queried
+// param: M - the module
+bool PrivLiveQuery::runOnModule(Module &M)
+{
+    SplitBB &SB = getAnalysis<SplitBB>();
+    const PrivCallGraph &CG = getAnalysis<PrivCallGraph>();
+
+    Graph.build(SB.Numbering, SB.BBFuncTable, SB.UnsplitCalls,
+                getAnalysis<DSAExternAnalysis>().callTargetIndex, CG.InSlice);
+
+    // Functions not in the slice have no CAPs used
+    FuncUse = getAnalysis<PropagateAnalysis>().FuncCAPTable;
+    BBRaise = getAnalysis<LocalAnalysis>().BBCAPTable;
+
+    // coarse live in of each function, in[F] = use[F] | out[F]
+    Graph.findCoarseLiveOut(FuncUse, FuncCoarse);
+    for (unsigned FID = 0, FE = FuncCoarse.size(); FID != FE; ++FID) {
+        if (!CG.isInSlice(FID)) {
+            FuncCoarse[FID] = CAPArray_t(0);
+            continue;
+        }
+        UnionCAPArrays(FuncCoarse[FID], FuncUse[FID]);
+    }
+
+    unsigned NumNodes = Graph.getNumNodes();
+    Known.assign(NumNodes, 0);
+    Live.assign(NumNodes, 0);
+    VisitedBy.assign(NumNodes, 0);
+    Search = 0;
+
+    return false;
+}
+
+
+// Search the live CAPs of the mask at any of the roots
+// A CAP is live at a node if the node reaches a node with the CAP
+// in its gen on the ICFG. The search is a DFS from the roots, and
+// stops once all CAPs of the mask are found. Nodes are not expanded
+// if the CAPs still searched are known at the node, or can't be
+// live in its function by the coarse live in. When a CAP is found,
+// it's live at all nodes on the DFS stack. When the search ends
+// without finding a CAP, the CAP is dead at all nodes visited.
+// param: Begin, End - the range of root node IDs
+//        Mask - the CAPs to search
+// return: the CAPs of the mask live at any of the roots
+CAPArray_t PrivLiveQuery::searchLive(const unsigned *Begin, const unsigned *End,
+                                     const CAPArray_t &Mask) const
+{
+    CAPArray_t Found(0);
+    CAPArray_t Remain = Mask;
+
+    // the visited marks of the last searches are stale
+    if (++Search == 0) {
+        std::fill(VisitedBy.begin(), VisitedBy.end(), 0);
+        Search = 1;
+    }
+    Visited.clear();
+
+    // the DFS stack of nodes and their next successors
+    std::vector<std::pair<unsigned, const unsigned *> > Stack;
+
+    auto Visit = [&](unsigned N) {
+        if (VisitedBy[N] == Search) { return; }
+        VisitedBy[N] = Search;
+        Visited.push_back(N);
+
+        // gen of the node, the CAPs raised and used by all callees
+        CAPArray_t Gen = Live[N];
+        if (N < BBRaise.size()) { UnionCAPArrays(Gen, BBRaise[N]); }
+        GatherUnionCAPArrays(Gen, FuncUse.data(),
+                             Graph.CallTargets.succ_begin(N),
+                             Graph.CallTargets.succ_end(N));
+
+        CAPArray_t Hit = Gen & Remain;
+        if (!IsCAPArrayEmpty(Hit)) {
+            UnionCAPArrays(Live[N], Hit);
+            UnionCAPArrays(Known[N], Hit);
+            for (auto SI = Stack.begin(), SE = Stack.end(); SI != SE; ++SI) {
+                UnionCAPArrays(Live[SI->first], Hit);
+                UnionCAPArrays(Known[SI->first], Hit);
+            }
+
+            UnionCAPArrays(Found, Hit);
+            Remain = Remain & ~Hit;
+        }
+
+        CAPArray_t Open = Remain & ~Known[N] & FuncCoarse[Graph.BBFunc[N]];
+        if (!IsCAPArrayEmpty(Open)) {
+            Stack.push_back(std::make_pair(N, Graph.Succs.succ_begin(N)));
+        }
+    };
+
+    for (const unsigned *RI = Begin; RI != End && !IsCAPArrayEmpty(Remain); ++RI) {
+        Visit(*RI);
+
+        while (!Stack.empty() && !IsCAPArrayEmpty(Remain)) {
+            unsigned N = Stack.back().first;
+            const unsigned *&SI = Stack.back().second;
+            if (SI == Graph.Succs.succ_end(N)) {
+                Stack.pop_back();
+                continue;
+            }
+
+            Visit(*SI++);
+        }
+        Stack.clear();
+    }
+
+    // All roots are searched, the visited nodes reach no gen of the
+    // CAPs not found
+    if (!IsCAPArrayEmpty(Remain)) {
+        for (auto VI = Visited.begin(), VE = Visited.end(); VI != VE; ++VI) {
+            UnionCAPArrays(Known[*VI], Remain);
+        }
+    }
+
+    return Found;
+}
+
+
+// The CAPs of the mask live in of a node
+// param: N - the node ID in the ICFG
+//        Mask - the CAPs to query
+CAPArray_t PrivLiveQuery::queryLiveIn(unsigned N, const CAPArray_t &Mask) const
+{
+    return searchLive(&N, &N + 1, Mask);
+}
+
+
+// The CAPs of the mask live out of a node, live in of its successors
+// param: N - the node ID in the ICFG
+//        Mask - the CAPs to query
+CAPArray_t PrivLiveQuery::queryLiveOut(unsigned N, const CAPArray_t &Mask) const
+{
+    return searchLive(Graph.Succs.succ_begin(N), Graph.Succs.succ_end(N), Mask);
+}
+
+
+// The CAPs of the mask live at the start of a BB
+// param: B - the BB
+//        Mask - the CAPs to query
+CAPArray_t PrivLiveQuery::queryLiveIn(const BasicBlock *B, const CAPArray_t &Mask) const
+{
+    unsigned N = getAnalysis<SplitBB>().Numbering.getBBID(B);
+    return N == INVALID_ID ? CAPArray_t(0) : queryLiveIn(N, Mask);
+}
+
+
+// The CAPs of the mask live at the end of a BB
+// param: B - the BB
+//        Mask - the CAPs to query
+CAPArray_t PrivLiveQuery::queryLiveOut(const BasicBlock *B, const CAPArray_t &Mask) const
+{
+    unsigned N = getAnalysis<SplitBB>().Numbering.getLastSegmentID(B);
+    return N == INVALID_ID ? CAPArray_t(0) : queryLiveOut(N, Mask);
+}
+
+
+// The segment ID of an instruction and if a call may follow it
+// The gen of a segment is from its calls, so the live after an
+// instruction is the live out of its segment if no call follows
+// it in the segment, or the live in of the segment otherwise.
+// param: I - the instruction
+//        Inclusive - if I itself is counted as following it
+//        CallFollows - if a call follows I in the segment, to save to
+// return: the segment ID, or INVALID_ID if not numbered
+unsigned PrivLiveQuery::findSegment(const Instruction *I, bool Inclusive,
+                                    bool &CallFollows) const
+{
+    const ModuleNumbering &Numbering = getAnalysis<SplitBB>().Numbering;
+
+    CallFollows = false;
+    unsigned N = Numbering.getSegmentID(I);
+    if (N == INVALID_ID) { return N; }
+
+    const Instruction *End = Numbering.isLastSegment(N) ? NULL :
+        Numbering.getSegmentEnd(N);
+
+    for (const Instruction *P = Inclusive ? I : I->getNextNode();
+         P != NULL && P != End; P = P->getNextNode()) {
+        if ((isa<CallInst>(P) || isa<InvokeInst>(P)) && !isa<IntrinsicInst>(P)) {
+            CallFollows = true;
+            break;
+        }
+    }
+
+    return N;
+}
+
+
+// The CAPs of the mask live before an instruction
+// param: I - the instruction
+//        Mask - the CAPs to query
+CAPArray_t PrivLiveQuery::queryLiveBefore(const Instruction *I,
+                                          const CAPArray_t &Mask) const
+{
+    bool CallFollows;
+    unsigned N = findSegment(I, true, CallFollows);
+    if (N == INVALID_ID) { return CAPArray_t(0); }
+
+    return CallFollows ? queryLiveIn(N, Mask) : queryLiveOut(N, Mask);
+}
+
+
+// The CAPs of the mask live after an instruction
+// param: I - the instruction
+//        Mask - the CAPs to query
+CAPArray_t PrivLiveQuery::queryLiveAfter(const Instruction *I,
+                                         const CAPArray_t &Mask) const
+{
+    bool CallFollows;
+    unsigned N = findSegment(I, false, CallFollows);
+    if (N == INVALID_ID) { return CAPArray_t(0); }
+
+    return CallFollows ? queryLiveIn(N, Mask) : queryLiveOut(N, Mask);
+}
+
+
+// Find where the CAPs of the mask are last live in a function
+// These are the points priv_remove would be inserted at: the end
+// of segments with CAPs live in but not live out, and the start of
+// CFG successors with CAPs live out of the predecessor but not in.
+// param: F - the function
+//        Mask - the CAPs to query
+//        Points - the instructions the CAPs are dead from, and the
+//                 CAPs, to save to
+void PrivLiveQuery::findLastLive(const Function *F, const CAPArray_t &Mask,
+                                 std::vector<std::pair<Instruction *, CAPArray_t> > &Points) const
+{
+    const ModuleNumbering &Numbering = getAnalysis<SplitBB>().Numbering;
+
+    for (Function::const_iterator BI = F->begin(), BE = F->end(); BI != BE; ++BI) {
+        unsigned N = Numbering.getBBID(&*BI);
+        if (N == INVALID_ID) { continue; }
+
+        do {
+            CAPArray_t In = queryLiveIn(N, Mask);
+            if (IsCAPArrayEmpty(In)) { continue; }
+
+            CAPArray_t Out = queryLiveOut(N, Mask);
+            CAPArray_t Drop = In & ~Out;
+            if (!IsCAPArrayEmpty(Drop)) {
+                Points.push_back(std::make_pair(Numbering.getSegmentEnd(N), Drop));
+            }
+
+            for (const unsigned *SI = Graph.cfg_succ_begin(N),
+                     *SE = Graph.cfg_succ_end(N); SI != SE; ++SI) {
+                Drop = Out & ~queryLiveIn(*SI, Mask);
+                if (!IsCAPArrayEmpty(Drop)) {
+                    Points.push_back(std::make_pair(Numbering.getSegmentBegin(*SI),
+                                                    Drop));
+                }
+            }
+        } while (!Numbering.isLastSegment(N++));
+    }
+}
+
+
+// Print out the answers of the queries from the options
+void PrivLiveQuery::print(raw_ostream &O, const Module *M) const
+{
+    CAPArray_t Mask(0);
+    for (auto CI = QueryCAPs.begin(), CE = QueryCAPs.end(); CI != CE; ++CI) {
+        unsigned CAP = findCAPByName(*CI);
+        if (CAP == INVALID_ID) {
+            errs() << "Unknown capability " << *CI << "\n";
+            continue;
+        }
+        AddCAP(Mask, CAP);
+    }
+
+    if (QueryCAPs.empty()) {
+        for (unsigned CAP = 0; CAP != CAP_TOTALNUM; ++CAP) {
+            AddCAP(Mask, CAP);
+        }
+    }
+
+    const Function *F = M->getFunction(QueryFunc);
+    if (F == NULL || F->isDeclaration()) {
+        errs() << "Function " << QueryFunc << " is not defined\n";
+        return;
+    }
+
+    // live after each call to the function queried
+    if (!QueryCall.empty()) {
+        for (auto BI = F->begin(), BE = F->end(); BI != BE; ++BI) {
+            for (auto II = BI->begin(), IE = BI->end(); II != IE; ++II) {
+                const Function *Callee = getCalledFunc(&*II);
+                if (Callee == NULL || Callee->getName() != QueryCall) { continue; }
+
+                O << "Live after" << *II << ": ";
+                dumpCAPArray(O, queryLiveAfter(&*II, Mask));
+            }
+        }
+    }
+
+    std::vector<std::pair<Instruction *, CAPArray_t> > Points;
+    findLastLive(F, Mask, Points);
+
+    O << "Last live in " << F->getName() << ":\n";
+    for (auto PI = Points.begin(), PE = Points.end(); PI != PE; ++PI) {
+        O << "Dead from" << *PI->first << ": ";
+        dumpCAPArray(O, PI->second);
+    }
+}
+
+
+// register pass
+char PrivLiveQuery::ID = 0;
+static RegisterPass<PrivLiveQuery> Q("PrivLiveQuery", "Demand-driven privilege live queries",
+                                     true, /* CFG only? */
+                                     true  /* Analysis Pass? */);
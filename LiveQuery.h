@@ -0,0 +1,103 @@
+// ====------------------  LiveQuery.h ----------*- C++ -*---====
+//
+// Demand-driven queries of the privilege live analysis. The live
+// CAPs of a mask are answered for a single instruction or BB by
+// searching the ICFG forward from it, without solving the live
+// analysis of the whole module. Functions are skipped when their
+// coarse live in, solved on the call graph, has none of the CAPs
+// searched, so only the part of the ICFG that may reach a relevant
+// priv_raise is walked. The CAPs found live or dead at each node
+// are memoized, and reused by later queries of the same run.
+//
+// ====-------------------------------------------------------====
+
+#ifndef __LIVEQUERY_H__
+#define __LIVEQUERY_H__
+
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "ADT.h"
+#include "ICFG.h"
+
+#include <vector>
+
+using namespace llvm::privAnalysis;
+
+namespace llvm {
+namespace liveQuery {
+
+struct PrivLiveQuery : public ModulePass
+{
+public:
+    static char ID;
+
+    // The ICFG of all BBs the queries search on
+    ICFG Graph;
+
+    PrivLiveQuery();
+
+    // Initialization
+    virtual bool doInitialization(Module &M);
+
+    // Run on Module Start
+    virtual bool runOnModule(Module &M);
+
+    // Preserve analysis usage
+    void getAnalysisUsage(AnalysisUsage &AU) const;
+
+    // Print out the answers of the queries from the options
+    void print(raw_ostream &O, const Module *M) const;
+
+    // The CAPs of the mask live in and live out of a node
+    CAPArray_t queryLiveIn(unsigned N, const CAPArray_t &Mask) const;
+    CAPArray_t queryLiveOut(unsigned N, const CAPArray_t &Mask) const;
+
+    // The CAPs of the mask live at the start and the end of a BB
+    CAPArray_t queryLiveIn(const BasicBlock *B, const CAPArray_t &Mask) const;
+    CAPArray_t queryLiveOut(const BasicBlock *B, const CAPArray_t &Mask) const;
+
+    // The CAPs of the mask live before and after an instruction
+    CAPArray_t queryLiveBefore(const Instruction *I, const CAPArray_t &Mask) const;
+    CAPArray_t queryLiveAfter(const Instruction *I, const CAPArray_t &Mask) const;
+
+    // Find where the CAPs of the mask are last live in a function
+    void findLastLive(const Function *F, const CAPArray_t &Mask,
+                      std::vector<std::pair<Instruction *, CAPArray_t> > &Points) const;
+
+private:
+    // The CAPs used by each function and its callees
+    FuncCAPTable_t FuncUse;
+
+    // The CAPs raised in each BB
+    BBCAPTable_t BBRaise;
+
+    // The coarse live in of each function, a node of a function
+    // can only have these CAPs live
+    FuncCAPTable_t FuncCoarse;
+
+    // Memo of each node: the CAPs known live or dead, and the CAPs
+    // known live. Filled by the queries, so they are mutable.
+    mutable BBCAPTable_t Known;
+    mutable BBCAPTable_t Live;
+
+    // The last search visiting each node, and the nodes visited
+    mutable std::vector<unsigned> VisitedBy;
+    mutable std::vector<unsigned> Visited;
+    mutable unsigned Search;
+
+    // Search the live CAPs of the mask at any of the roots
+    CAPArray_t searchLive(const unsigned *Begin, const unsigned *End,
+                          const CAPArray_t &Mask) const;
+
+    // The segment ID of an instruction and if a call may follow it
+    unsigned findSegment(const Instruction *I, bool Inclusive,
+                         bool &CallFollows) const;
+};
+
+} // namespace liveQuery
+} // namespace llvm
+
+#endif
@@ -32,62 +32,33 @@ bool LocalAnalysis::doInitialization(Module &M)
 }
 
 
-// RetrieveAllCAP
-// Retrieve all capabilities from params of function call
-// param: CI - call instruction to retrieve from
-//        CAParray - the array of capability to save to
-void LocalAnalysis::RetrieveAllCAP(CallInst *CI, CAPArray_t &CAPArray)
-{
-    int numArgs = (int) CI->getNumArgOperands();
-    assert(CI != NULL && "The CallInst is NULL!\n");
-
-    // Note: Skip the first param of priv_lower for it's num of args
-    for (int i = 1; i < numArgs; ++i) {
-        // retrieve integer value
-        Value *v = CI->getArgOperand(i);
-        ConstantInt *I = dyn_cast<ConstantInt>(v);
-        unsigned int iarg = I->getZExtValue();
-
-        // Add it to the array
-        CAPArray |= 1 << iarg;
-    }
-}
-
-
 // Run on Module start
 // param: Module
 bool LocalAnalysis::runOnModule(Module &M)
 {
     // retrieve all data for later use
     SplitBB &SB = getAnalysis<SplitBB>();
-    BBFuncTable = SB.BBFuncTable;
-    ExtraJMPBB = SB.ExtraJMPBB;
-  
-    // find all users of targeted function
-    Function *F = M.getFunction(PRIVRAISE);
+    ModuleNumbering &Numbering = SB.Numbering;
 
+    // Tables are indexed by the IDs from SplitBB
+    FuncCAPTable.assign(Numbering.getNumFuncs(), 0);
+    BBCAPTable.assign(Numbering.getNumBBs(), 0);
+  
     // Protector: didn't find any function TARGET_FUNC
-    assert(F && "Didn't find function PRIV_RAISE function");
-
-    // Find all user instructions of function in the module
-    for (Value::user_iterator UI = F->user_begin(), UE = F->user_end();
-         UI != UE; ++UI) {
-
-        // If it's a call Inst calling the targeted function
-        CallInst *CI = dyn_cast<CallInst>(*UI);
-        if (CI == NULL || CI->getCalledFunction() != F) {
-            continue;
+    assert(M.getFunction(PRIVRAISE) && "Didn't find function PRIV_RAISE function");
+
+    // Find all priv_raise calls from the summaries of functions
+    for (unsigned FID = 0, FE = SB.Summary.size(); FID != FE; ++FID) {
+        const FuncSummary &FS = SB.Summary[FID];
+
+        // Add CAP to Map (Function ID => array of CAPs)
+        // and Map (BB ID => array of CAPs)
+        for (auto RI = FS.RaiseCalls.begin(), RE = FS.RaiseCalls.end();
+             RI != RE; ++RI) {
+            AddToBBCAPTable(BBCAPTable, Numbering.getSegmentID(RI->first),
+                            RI->second);
         }
-
-        // Retrieve all capabilities from params of function call
-        CAPArray_t CAParray = 0;
-        RetrieveAllCAP(CI, CAParray);
-
-        // Get the function where the Instr is in
-        // Add CAP to Map (Function* => array of CAPs)
-        // and Map (BB * => array of CAPs)
-        AddToBBCAPTable(BBCAPTable, CI->getParent(), CAParray);
-        AddToFuncCAPTable(FuncCAPTable, CI->getParent()->getParent(), CAParray);
+        AddToFuncCAPTable(FuncCAPTable, FID, FS.Gen);
     }
 
     return false;
@@ -109,7 +80,9 @@ void LocalAnalysis::getAnalysisUsage(AnalysisUsage &AU) const
 // Print out information for debugging purposes
 void LocalAnalysis::print(raw_ostream &O, const Module *M) const
 {
-    dumpCAPTable(FuncCAPTable);
+    SplitBB &SB = getAnalysis<SplitBB>();
+
+    dumpCAPTable(FuncCAPTable, SB.Numbering);
 }
 
 
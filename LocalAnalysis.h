@@ -28,19 +28,14 @@ struct LocalAnalysis : public ModulePass
 public:
     static char ID;
     // Data structure for local priv capability use in each function
-    // Maps from InstCalls to -> Array of Capabilities
+    // Maps from Function IDs to -> Array of Capabilities
     FuncCAPTable_t FuncCAPTable;
 
     // Data structure for priv capability use in each BB
-    // Maps from BB to -> Array of Capabilities
+    // Maps from BB IDs to -> Array of Capabilities
+    // The BB callees and the split BBs are read from SplitBB
     BBCAPTable_t BBCAPTable;
 
-    // Map from BB to its non-external Function Calls
-    BBFuncTable_t BBFuncTable;
-
-    // Vector to store new direct JMP as terminator
-    std::vector<BasicBlock *> ExtraJMPBB;
-
     // constructor
     LocalAnalysis();
 
@@ -55,9 +50,6 @@ public:
 
     // Print out information for debugging purposes
     void print(raw_ostream &O, const Module *M) const;
-private:
-    // Retrieve all capabilities from params of function call
-    void RetrieveAllCAP(CallInst *CI, CAPArray_t &CAParray);
 
 }; // endof struct PrivAnalysis
 
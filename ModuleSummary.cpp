@@ -0,0 +1,101 @@
+// ====-----------------  ModuleSummary.cpp ------*- C++ -*---====
+//
+// Summaries of all functions in the module, built from one walk
+// over all instructions.
+//
+// ====-------------------------------------------------------====
+
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+
+#include "ModuleSummary.h"
+
+#include <algorithm>
+
+
+namespace llvm {
+namespace privAnalysis {
+
+
+// Number all functions and summarize them in one walk of the module
+// Functions are numbered first in the order of the module, so that
+// callees are numbered before they are seen in the walk.
+// param: M - the module
+//        Numbering - the numbering to number functions with
+//        Summary - the summaries to save to
+void SummarizeModule(Module &M, ModuleNumbering &Numbering,
+                     ModuleSummary_t &Summary)
+{
+    for (Module::iterator FI = M.begin(), FE = M.end(); FI != FE; ++FI) {
+        Numbering.addFunction(&*FI);
+    }
+
+    Summary.assign(Numbering.getNumFuncs(), FuncSummary());
+    Function *RaiseFunc = M.getFunction(PRIVRAISE);
+
+    for (Module::iterator FI = M.begin(), FE = M.end(); FI != FE; ++FI) {
+        Function *F = &*FI;
+        FuncSummary &FS = Summary[Numbering.getFuncID(F)];
+
+        FS.ExternCallable = !F->hasLocalLinkage() || F->hasAddressTaken();
+
+        for (Function::iterator BI = F->begin(), BE = F->end(); BI != BE; ++BI) {
+            for (BasicBlock::iterator II = BI->begin(), IE = BI->end();
+                 II != IE; ++II) {
+                CallSite CS(&*II);
+                if (!CS || CS.isInlineAsm()) { continue; }
+
+                Function *Callee = CS.getCalledFunction();
+                if (Callee == NULL) {
+                    FS.IndirectCalls.push_back(CS);
+                    continue;
+                }
+
+                if (!Callee->isIntrinsic()) {
+                    FS.Callees.push_back(Numbering.getFuncID(Callee));
+                }
+
+                CallInst *CI = dyn_cast<CallInst>(&*II);
+                if (CI == NULL) { continue; }
+
+                FS.DirectCalls.push_back(CI);
+
+                if (Callee == RaiseFunc) {
+                    CAPArray_t CAPArray = 0;
+                    RetrieveAllCAP(CI, CAPArray);
+                    FS.RaiseCalls.push_back(std::make_pair(CI, CAPArray));
+                    FS.Gen |= CAPArray;
+                }
+            }
+        }
+
+        std::sort(FS.Callees.begin(), FS.Callees.end());
+        FS.Callees.erase(std::unique(FS.Callees.begin(), FS.Callees.end()),
+                         FS.Callees.end());
+    }
+}
+
+
+// RetrieveAllCAP
+// Retrieve all capabilities from params of function call
+// param: CI - call instruction to retrieve from
+//        CAParray - the array of capability to save to
+void RetrieveAllCAP(CallInst *CI, CAPArray_t &CAPArray)
+{
+    int numArgs = (int) CI->getNumArgOperands();
+    assert(CI != NULL && "The CallInst is NULL!\n");
+
+    // Note: Skip the first param of priv_lower for it's num of args
+    for (int i = 1; i < numArgs; ++i) {
+        // retrieve integer value
+        Value *v = CI->getArgOperand(i);
+        ConstantInt *I = dyn_cast<ConstantInt>(v);
+        unsigned int iarg = I->getZExtValue();
+
+        // Add it to the array
+        AddCAP(CAPArray, iarg);
+    }
+}
+
+} // namespace privAnalysis
+} // namespace llvm
@@ -0,0 +1,67 @@
+// ====-----------------  ModuleSummary.h --------*- C++ -*---====
+//
+// Summaries of all functions in the module, built from one walk
+// over all instructions. Each summary records the capabilities
+// raised in the function, its direct calls and callees, and its
+// indirect call sites. Later passes read the summaries instead of
+// walking the IR, the users of functions or the call graph again.
+//
+// ====-------------------------------------------------------====
+
+#ifndef __MODULESUMMARY_H__
+#define __MODULESUMMARY_H__
+
+#include "llvm/IR/CallSite.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+
+#include "ADT.h"
+
+#include <utility>
+#include <vector>
+
+namespace llvm {
+namespace privAnalysis {
+
+// Summary of a function
+struct FuncSummary
+{
+public:
+    // CAPs raised by all priv_raise calls in the function
+    CAPArray_t Gen;
+
+    // priv_raise calls and the CAPs raised by each of them
+    std::vector<std::pair<CallInst *, CAPArray_t> > RaiseCalls;
+
+    // Call instructions calling a function directly, including
+    // priv_* calls and intrinsics, in the order of BBs
+    std::vector<CallInst *> DirectCalls;
+
+    // IDs of direct callees except intrinsics, sorted and unique
+    std::vector<unsigned> Callees;
+
+    // Indirect call sites, not counting inline asm
+    std::vector<CallSite> IndirectCalls;
+
+    // If the function may be called from outside of the module or
+    // through pointers, i.e. it's called by the external calling
+    // node of the LLVM callgraph
+    bool ExternCallable;
+
+    FuncSummary() : Gen(0), ExternCallable(false) { }
+};
+
+// The summaries of all functions, indexed by function IDs
+typedef std::vector<FuncSummary> ModuleSummary_t;
+
+// Number all functions and summarize them in one walk of the module
+void SummarizeModule(Module &M, ModuleNumbering &Numbering,
+                     ModuleSummary_t &Summary);
+
+// Retrieve all capabilities from params of function call
+void RetrieveAllCAP(CallInst *CI, CAPArray_t &CAPArray);
+
+} // namespace privAnalysis
+} // namespace llvm
+
+#endif
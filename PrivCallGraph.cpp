@@ -0,0 +1,251 @@
+// ====---------------  PrivCallGraph.cpp ---------*- C++ -*---====
+//
+// The call graph of the module over function IDs, shared by all
+// passes. Direct calls are from the module summary, and indirect
+// calls are the callees resolved by DSA, or the calls external
+// node if DSA is incomplete. The graph is built once per pipeline,
+// passes request it with getAnalysisUsage.
+//
+// The slice of functions reachable from main is found on the graph,
+// the passes only analyze and instrument functions in the slice.
+//
+// ====-------------------------------------------------------====
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/Support/CommandLine.h"
+
+#include "PrivCallGraph.h"
+#include "SplitBB.h"
+#include "DSAExternAnalysis.h"
+
+#include <algorithm>
+#include <vector>
+
+
+using namespace llvm;
+using namespace llvm::privAnalysis;
+using namespace llvm::splitBB;
+using namespace llvm::dsaexterntarget;
+using namespace llvm::privCallGraph;
+
+#define DEBUG_TYPE "privcallgraph"
+
+STATISTIC(NumSlicedFuncs, "Number of functions not reachable from main");
+
+static cl::opt<bool> NoSlice("priv-no-slice",
+    cl::desc("Analyze all functions, not only the functions reachable from main"),
+    cl::init(false));
+
+
+PrivCallGraph::PrivCallGraph() : ModulePass(ID) { }
+
+
+// Require analysis usage
+void PrivCallGraph::getAnalysisUsage(AnalysisUsage &AU) const
+{
+    AU.addRequired<SplitBB>();
+    AU.addRequired<DSAExternAnalysis>();
+
+    AU.setPreservesAll();
+}
+
+
+// Do initialization
+bool PrivCallGraph::doInitialization(Module &M)
+{
+    return false;
+}
+
+
+// Adding dummy function of type void(*)(void)
+// param: M    - the module
+//        name - function name
+Function* PrivCallGraph::InsertDummyFunc(Module &M, const StringRef name)
+{
+    Type *voidTy = Type::getVoidTy(M.getContext());
+    std::vector<Type *>Params;
+
+    FunctionType *dummyType = FunctionType::get(voidTy, ArrayRef<Type *>(Params),
+                                                false);
+    Constant *func = M.getOrInsertFunction(name, dummyType);
+    return dyn_cast<Function>(func);
+}
+
+
+// Build the call graph from the summaries of functions and the
+// callees resolved by DSA
+// param: M - the module
+bool PrivCallGraph::runOnModule(Module &M)
+{
+    SplitBB &SB = getAnalysis<SplitBB>();
+    ModuleNumbering &Numbering = SB.Numbering;
+    const ModuleSummary_t &Summary = SB.Summary;
+    const FunctionMap_t &callgraphMap = getAnalysis<DSAExternAnalysis>().callgraphMap;
+
+    // Number the external nodes after all functions of the module
+    callingNodeFunc = InsertDummyFunc(M, "CallingExternNode");
+    callsNodeFunc = InsertDummyFunc(M, "CallsExternNode");
+    callingNodeID = Numbering.numberFunction(callingNodeFunc);
+    callsNodeID = Numbering.numberFunction(callsNodeFunc);
+
+    AdjList_t Callees(Numbering.getNumFuncs());
+
+    for (unsigned FID = 0, FE = Summary.size(); FID != FE; ++FID) {
+        Function *F = Numbering.getFunc(FID);
+        const FuncSummary &FS = Summary[FID];
+        std::vector<unsigned> &FCallees = Callees[FID];
+
+        FCallees = FS.Callees;
+
+        if (FS.ExternCallable) {
+            Callees[callingNodeID].push_back(FID);
+        }
+
+        // A function declared but not defined may call anything
+        if (F->isDeclaration()) {
+            FCallees.push_back(callsNodeID);
+            continue;
+        }
+
+        if (FS.IndirectCalls.empty()) { continue; }
+
+        // Indirect calls are to the DSA callees if all indirect calls
+        // of the function are complete in DSA, or to the calls
+        // external node otherwise
+        auto CI = callgraphMap.find(F);
+        if (CI == callgraphMap.end()) {
+            FCallees.push_back(callsNodeID);
+            continue;
+        }
+
+        for (auto DI = CI->second.begin(), DE = CI->second.end(); DI != DE; ++DI) {
+            FCallees.push_back(Numbering.getFuncID(*DI));
+        }
+
+        std::sort(FCallees.begin(), FCallees.end());
+        FCallees.erase(std::unique(FCallees.begin(), FCallees.end()),
+                       FCallees.end());
+    }
+
+    // calls to the calls external node may call back to all functions
+    // called by the external calling node
+    Callees[callsNodeID].push_back(callingNodeID);
+
+    Calls.build(Callees);
+    Callers.buildReverse(Calls);
+
+    findSlice(M);
+
+    return false;
+}
+
+
+// Add the functions of a global array of constructors or destructors
+// param: M - the module
+//        Name - the name of the global array
+//        Roots - the functions to save to
+static void addGlobalCtors(Module &M, StringRef Name, std::vector<Function *> &Roots)
+{
+    GlobalVariable *GV = M.getNamedGlobal(Name);
+    if (GV == NULL || !GV->hasInitializer()) { return; }
+
+    ConstantArray *CA = dyn_cast<ConstantArray>(GV->getInitializer());
+    if (CA == NULL) { return; }
+
+    for (unsigned i = 0, e = CA->getNumOperands(); i != e; ++i) {
+        ConstantStruct *CS = dyn_cast<ConstantStruct>(CA->getOperand(i));
+        if (CS == NULL || CS->getNumOperands() < 2) { continue; }
+
+        if (Function *F = dyn_cast<Function>(CS->getOperand(1)->stripPointerCasts())) {
+            Roots.push_back(F);
+        }
+    }
+}
+
+
+// Find the slice of functions reachable from main
+// The roots are main and the global constructors and destructors.
+// The whole program is in the module, so the calls external node,
+// i.e. unresolved indirect calls and calls to declarations, may
+// only call back to the address taken functions, not to all
+// functions callable from outside. All functions are in the slice
+// if there is no main.
+// param: M - the module
+void PrivCallGraph::findSlice(Module &M)
+{
+    ModuleNumbering &Numbering = getAnalysis<SplitBB>().Numbering;
+    unsigned NumFuncs = Calls.getNumNodes();
+
+    Function *mainFunc = M.getFunction("main");
+    if (NoSlice || mainFunc == NULL || mainFunc->isDeclaration()) {
+        InSlice.assign(NumFuncs, true);
+        return;
+    }
+
+    std::vector<Function *> Roots(1, mainFunc);
+    addGlobalCtors(M, "llvm.global_ctors", Roots);
+    addGlobalCtors(M, "llvm.global_dtors", Roots);
+
+    InSlice.assign(NumFuncs, false);
+    std::vector<unsigned> Worklist;
+    for (auto RI = Roots.begin(), RE = Roots.end(); RI != RE; ++RI) {
+        unsigned FID = Numbering.getFuncID(*RI);
+        if (FID != INVALID_ID && !InSlice[FID]) {
+            InSlice[FID] = true;
+            Worklist.push_back(FID);
+        }
+    }
+
+    while (!Worklist.empty()) {
+        unsigned FID = Worklist.back();
+        Worklist.pop_back();
+
+        for (const unsigned *CI = Calls.succ_begin(FID),
+                 *CE = Calls.succ_end(FID); CI != CE; ++CI) {
+            if (InSlice[*CI]) { continue; }
+            InSlice[*CI] = true;
+
+            if (*CI != callsNodeID) {
+                Worklist.push_back(*CI);
+                continue;
+            }
+
+            // the calls external node calls back to address taken functions
+            InSlice[callingNodeID] = true;
+            for (unsigned AID = 0; AID != NumFuncs; ++AID) {
+                Function *F = Numbering.getFunc(AID);
+                if (!InSlice[AID] && F->hasAddressTaken()) {
+                    InSlice[AID] = true;
+                    Worklist.push_back(AID);
+                }
+            }
+        }
+    }
+
+    NumSlicedFuncs += std::count(InSlice.begin(), InSlice.end(), false);
+}
+
+
+// Print out the callees of each function
+void PrivCallGraph::print(raw_ostream &O, const Module *M) const
+{
+    const ModuleNumbering &Numbering = getAnalysis<SplitBB>().Numbering;
+
+    for (unsigned FID = 0, FE = Calls.getNumNodes(); FID != FE; ++FID) {
+        O << Numbering.getFunc(FID)->getName() << " is calling:\n";
+
+        for (const unsigned *CI = Calls.succ_begin(FID),
+                 *CE = Calls.succ_end(FID); CI != CE; ++CI) {
+            O << "\t" << Numbering.getFunc(*CI)->getName() << "\n";
+        }
+    }
+}
+
+
+// register pass
+char PrivCallGraph::ID = 0;
+static RegisterPass<PrivCallGraph> G("PrivCallGraph", "Call graph of privilege analysis",
+                                     true, /* CFG only? */
+                                     true  /* Analysis Pass? */);
@@ -0,0 +1,78 @@
+// ====----------------  PrivCallGraph.h ---------*- C++ -*---====
+//
+// The call graph of the module over function IDs, shared by all
+// passes. Direct calls are from the module summary, and indirect
+// calls are the callees resolved by DSA, or the calls external
+// node if DSA is incomplete. The graph is built once per pipeline,
+// passes request it with getAnalysisUsage.
+//
+// The slice of functions reachable from main is found on the graph,
+// the passes only analyze and instrument functions in the slice.
+//
+// ====-------------------------------------------------------====
+
+#ifndef __PRIVCALLGRAPH_H__
+#define __PRIVCALLGRAPH_H__
+
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "ADT.h"
+
+#include <vector>
+
+using namespace llvm::privAnalysis;
+
+namespace llvm {
+namespace privCallGraph {
+
+struct PrivCallGraph : public ModulePass
+{
+public:
+    static char ID;
+
+    // The call graph over function IDs from SplitBB, from callers
+    // to callees, with nodes for the external nodes
+    CSRGraph Calls;
+
+    // The reverse graph of Calls, from callees to callers
+    CSRGraph Callers;
+
+    // Dummy functions of the external calling node, which calls
+    // all functions callable from outside, and the calls external
+    // node, which is called by unresolved calls and may call back
+    // to all functions the external calling node calls
+    Function *callingNodeFunc;
+    Function *callsNodeFunc;
+    unsigned callingNodeID;
+    unsigned callsNodeID;
+
+    // If each function ID is in the slice reachable from main
+    std::vector<bool> InSlice;
+
+    PrivCallGraph();
+
+    void getAnalysisUsage(AnalysisUsage &AU) const;
+
+    virtual bool doInitialization(Module &M);
+
+    virtual bool runOnModule(Module &M);
+
+    void print(raw_ostream &O, const Module *M) const;
+
+    bool isInSlice(unsigned FID) const { return InSlice[FID]; }
+
+private:
+    // Insert dummy function
+    static Function *InsertDummyFunc(Module &M, const StringRef name);
+
+    // Find the slice of functions reachable from main
+    void findSlice(Module &M);
+};
+
+} // namespace privCallGraph
+} // namespace llvm
+
+#endif
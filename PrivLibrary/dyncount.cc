@@ -9,6 +9,7 @@
 #include "dyncount.h"
 
 
+#include <cstdarg>
 #include <cstdio>
 #include <cstdlib>
 #include <string>
@@ -18,7 +19,7 @@
 #include <algorithm>
 
 
-static const char *CAPString[CAP_NUM] = {
+static const char *CAPString[] = {
     "CapChown",
     "CapDacOverride",
     "CapDacReadSearch",
@@ -55,46 +56,59 @@ static const char *CAPString[CAP_NUM] = {
     "CapMacAdmin",
     "CapSyslog",
     "CapWakeAlarm",
-    "CapBlockSuspend"
+    "CapBlockSuspend",
+    "CapAuditRead",
+    "CapPerfmon",
+    "CapBpf",
+    "CapCheckpointRestore"
 };
 
 
+// The capability set, one uint64_t for every 64 capabilities
+typedef std::vector<uint64_t> CAPSet_t;
+
+
 // The capability set count of LOC
-static std::map<uint64_t, int>CAPSetLOCCount;
+static std::map<CAPSet_t, int>CAPSetLOCCount;
 
 
 
-// Internal method for printing out capabilities
-void printCAP(uint64_t CAPArray)
+// Internal method for the name of a capability
+static const char *getCAPName(unsigned CAP)
 {
-    uint64_t mask = (uint64_t) 1 << CAP_NUM;
+    return CAP < sizeof(CAPString) / sizeof(CAPString[0]) ? CAPString[CAP]
+                                                          : "CapUnknown";
+}
 
-    if (CAPArray == (uint64_t)0) {
-        printf("empty,");
-        return;
-    }
 
-    for (int i = 0; CAPArray != (uint64_t) 0; ++i) {
-        if (CAPArray & mask) {
-            printf("%s,", CAPString[i]);
+// Internal method for printing out capabilities
+void printCAP(const CAPSet_t &CAPArray)
+{
+    bool isempty = true;
+
+    for (unsigned w = 0; w != CAPArray.size(); ++w) {
+        for (unsigned i = 0; i != 64; ++i) {
+            if (CAPArray[w] & ((uint64_t)1 << i)) {
+                printf("%s,", getCAPName(w * 64 + i));
+                isempty = false;
+            }
         }
+    }
 
-        CAPArray &= ~mask;
-        mask >>= 1;
+    if (isempty) {
+        printf("empty,");
     }
     return;
 }
 
 
-// Internal method for counting live capability in uint64_t CAPArray
-int countCAP(uint64_t CAPArray)
+// Internal method for counting live capability in CAPArray
+int countCAP(const CAPSet_t &CAPArray)
 {
-    // TODO: This is naive and inefficient. Find a quicker way
     int count = 0;
 
-    while(CAPArray) {
-        count += CAPArray & 1;
-        CAPArray >>= 1;
+    for (unsigned w = 0; w != CAPArray.size(); ++w) {
+        count += __builtin_popcountll(CAPArray[w]);
     }
 
     return count;
@@ -103,8 +117,8 @@ int countCAP(uint64_t CAPArray)
 
 
 // Internal method for sorting map, compare CAPSetLOCCount by live CAPs in CAPArray 
-bool compareCAPLOC(const std::pair<uint64_t, int> A,
-                  const std::pair<uint64_t, int> B)
+bool compareCAPLOC(const std::pair<CAPSet_t, int> &A,
+                   const std::pair<CAPSet_t, int> &B)
 {
     return countCAP(A.first) > countCAP(B.first);
 }
@@ -129,21 +143,49 @@ int initCount()
 int addCount(int LOC, uint64_t CAPArray)
 {
 
-    CAPSetLOCCount[CAPArray] += LOC;
+    CAPSetLOCCount[CAPSet_t(1, CAPArray)] += LOC;
     
     return 0;
 }
 
 
+/* add LOC to the CAPArray data structure, for capability sets of
+ * more than one uint64_t
+ * param: LOC - the LOC of the capability set
+ *        NumWords - the number of uint64_t of the capability set
+ *        ... - the capability set, NumWords uint64_t from the lowest
+ */
+int addCountWide(int LOC, int NumWords, ...)
+{
+    CAPSet_t CAPArray(NumWords);
+    va_list ap;
+
+    va_start(ap, NumWords);
+    for (int i = 0; i < NumWords; ++i) {
+        CAPArray[i] = va_arg(ap, uint64_t);
+    }
+    va_end(ap);
+
+    // drop the high zero words, so sets equal to a narrow set are merged
+    while (CAPArray.size() > 1 && CAPArray.back() == 0) {
+        CAPArray.pop_back();
+    }
+
+    CAPSetLOCCount[CAPArray] += LOC;
+
+    return 0;
+}
+
+
 /* report the counting data structure */
 int reportCount()
 {
     // copy origin map to sort
-    std::vector<std::pair<uint64_t, int> >CAPSetLOCCopy(CAPSetLOCCount.begin(),
+    std::vector<std::pair<CAPSet_t, int> >CAPSetLOCCopy(CAPSetLOCCount.begin(),
                                                         CAPSetLOCCount.end());
     std::sort(CAPSetLOCCopy.begin(), CAPSetLOCCopy.end(), compareCAPLOC);
 
-    for (std::vector<std::pair<uint64_t, int> >::iterator 
+    for (std::vector<std::pair<CAPSet_t, int> >::iterator 
              i = CAPSetLOCCopy.begin(), e = CAPSetLOCCopy.end();
          i != e; ++i) {
 
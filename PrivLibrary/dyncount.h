@@ -31,6 +31,16 @@ int initCount();
 int addCount(int LOC, uint64_t CAPArray);
 
 
+/* add LOC to the CAPArray data structure, for capability sets of
+ * more than one uint64_t. This is inserted instead of addCount if
+ * the pass is built with PRIV_CAP_WORDS > 1.
+ * param: LOC - the LOC of the capability set
+ *        NumWords - the number of uint64_t of the capability set
+ *        ... - the capability set, NumWords uint64_t from the lowest
+ */
+int addCountWide(int LOC, int NumWords, ...);
+
+
 /* report the counting data structure */
 int reportCount();
 
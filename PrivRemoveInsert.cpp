@@ -9,27 +9,39 @@
 
 #include <llvm/IR/Constant.h>
 #include <llvm/IR/LLVMContext.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Transforms/Utils/BasicBlockUtils.h>
 
 #include <map>
 
 #include "ADT.h"
 #include "PrivRemoveInsert.h"
 #include "GlobalLiveAnalysis.h"
+#include "SplitBB.h"
 
 
 using namespace llvm;
+using namespace llvm::splitBB;
 using namespace llvm::globalLiveAnalysis;
 using namespace llvm::privremoveinsert;
 
 
+// Keep the BBs split by SplitBB in the output
+static cl::opt<bool> KeepSplitBB("priv-keep-split",
+                                 cl::desc("Don't merge BBs split by SplitBB "
+                                          "after inserting priv_remove"),
+                                 cl::init(false));
+
+
 // PrivRemoveInsert constructor
-PrivRemoveInsert::PrivRemoveInsert() : ModulePass(ID)
+PrivRemoveInsert::PrivRemoveInsert() : ModulePass(ID), NumMergedBB(0)
 { }
 
 
 // Preserve analysis usage
 void PrivRemoveInsert::getAnalysisUsage(AnalysisUsage &AU) const
 {
+    AU.addRequired<SplitBB>();
     AU.addRequired<GlobalLiveAnalysis>();
 }
 
@@ -69,7 +81,7 @@ void PrivRemoveInsert::addToArgs(std::vector<Value *>& Args,
     int cap = 0;
 
     for (cap = 0; cap < CAP_TOTALNUM; ++cap) {
-        if ((CAPArray & (1 << cap)) == 0) {
+        if (!HasCAP(CAPArray, cap)) {
             continue;
         }
 
@@ -94,16 +106,18 @@ void PrivRemoveInsert::addToArgs(std::vector<Value *>& Args,
 bool PrivRemoveInsert::runOnModule(Module &M)
 {
     GlobalLiveAnalysis &GA = getAnalysis<GlobalLiveAnalysis>();
-    BBCAPTable_t BBCAPTable_dropEnd = GA.BBCAPTable_dropEnd;
-    BBCAPTable_t BBCAPTable_dropStart = GA.BBCAPTable_dropStart;
+    const ModuleNumbering &Numbering = getAnalysis<SplitBB>().Numbering;
+    const BBCAPSetTable_t &BBCAPTable_dropEnd = GA.BBCAPTable_dropEnd;
+    const BBCAPSetTable_t &BBCAPTable_dropStart = GA.BBCAPTable_dropStart;
 
-    FuncCAPTable_t FuncLiveCAPTable_in = GA.FuncLiveCAPTable_in;
+    const FuncCAPTable_t &FuncLiveCAPTable_in = GA.FuncLiveCAPTable_in;
 
     // Insert remove call at the top of the main function
     Function *PrivRemoveFunc = getRemoveFunc(M);
     std::vector<Value *> Args = {};
     Function *mainFunc = M.getFunction("main");
-    CAPArray_t &FirstCAPArray = FuncLiveCAPTable_in[mainFunc];
+    CAPArray_t FirstCAPArray
+        = FuncLiveCAPTable_in[Numbering.getFuncID(mainFunc)];
 
     // Find all CAPs that's not alive - reverse of FuncLiveIn
     ReverseCAPArray(FirstCAPArray);
@@ -115,42 +129,74 @@ bool PrivRemoveInsert::runOnModule(Module &M)
                      PRIV_REMOVE_CALL, firstInst);
 
     // Insert call to all BBs with removable capabilities  
-    for (auto BI = BBCAPTable_dropEnd.begin(), BE = BBCAPTable_dropEnd.end();
-         BI != BE; ++BI) {
-        BasicBlock *BB = BI->first;
-        CAPArray_t &CAPArray = BI->second;
+    for (unsigned BID = 0, BE = BBCAPTable_dropEnd.size(); BID != BE; ++BID) {
+        if (BBCAPTable_dropEnd[BID] == CAPSET_EMPTY) { continue; }
+        const CAPArray_t &CAPArray = GA.CAPSets.getSet(BBCAPTable_dropEnd[BID]);
+
+        BasicBlock *BB = Numbering.getBB(BID);
         Args.clear();
 
         addToArgs(Args, CAPArray);
 
-        // create call instruction
+        // create call instruction at the end of the BB, or the segment
         assert(BB->getTerminator() != NULL && "BB has a NULL teminator!");
         CallInst::Create(PrivRemoveFunc, ArrayRef<Value *>(Args), 
-                         PRIV_REMOVE_CALL, BB->getTerminator());
+                         PRIV_REMOVE_CALL, Numbering.getSegmentEnd(BID));
+        RemoveAtEnd.insert(BB);
     }
 
 
     // Insert at the start of the dropStart
-    for (auto BI = BBCAPTable_dropStart.begin(), BE = BBCAPTable_dropStart.end();
-         BI != BE; ++BI) {
-        BasicBlock *BB = BI->first;
-        CAPArray_t &CAPArray = BI->second;
+    for (unsigned BID = 0, BE = BBCAPTable_dropStart.size(); BID != BE; ++BID) {
+        if (BBCAPTable_dropStart[BID] == CAPSET_EMPTY) { continue; }
+        const CAPArray_t &CAPArray = GA.CAPSets.getSet(BBCAPTable_dropStart[BID]);
+
         Args.clear();
 
         addToArgs(Args, CAPArray);
 
-        // create call instruction
+        // create call instruction at the start of the BB, or the segment
         CallInst::Create(PrivRemoveFunc, ArrayRef<Value *>(Args), 
-                         PRIV_REMOVE_CALL, BB->getFirstNonPHI());
+                         PRIV_REMOVE_CALL, Numbering.getSegmentBegin(BID));
+        RemoveAtStart.insert(Numbering.getBB(BID));
+    }
+
+    // Merge the BBs only split for the analysis
+    if (!KeepSplitBB) {
+        mergeSplitBBs(getAnalysis<SplitBB>().ExtraJMPBB);
     }
 
     return true;
 }
 
 
+// Merge BBs split by SplitBB back into their predecessors, unless
+// priv_remove is inserted at the boundary, i.e. at the end of the
+// predecessor or the start of the BB. BBs are merged from the last
+// one of each split BB, so the BBs in ExtraJMPBB are not deleted
+// before they are visited.
+// param: ExtraJMPBB - the BBs ending with the jmp created by SplitBB
+void PrivRemoveInsert::mergeSplitBBs(const std::vector<BasicBlock *> &ExtraJMPBB)
+{
+    for (auto BI = ExtraJMPBB.rbegin(), BE = ExtraJMPBB.rend(); BI != BE; ++BI) {
+        BasicBlock *BB = *BI;
+        BasicBlock *Succ = BB->getTerminator()->getSuccessor(0);
+
+        if (RemoveAtEnd.count(BB) || RemoveAtStart.count(Succ)) {
+            continue;
+        }
+
+        if (MergeBlockIntoPredecessor(Succ)) {
+            ++NumMergedBB;
+        }
+    }
+}
+
+
 // Print out information for debugging purposes
 void PrivRemoveInsert::print(raw_ostream &O, const Module *M) const
 {
+    O << "Merged split BB size: " << NumMergedBB << "\n";
 }
 
 
@@ -158,6 +204,6 @@ void PrivRemoveInsert::print(raw_ostream &O, const Module *M) const
 // register pass
 char PrivRemoveInsert::ID = 0;
 static RegisterPass<PrivRemoveInsert> I("PrivRemoveInsert", "Insert PrivRemove calls", 
-                                        true, /* CFG only? */
+                                        false, /* CFG only? */
                                         false /* Analysis pass? */);
 
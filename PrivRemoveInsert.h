@@ -9,6 +9,7 @@
 #ifndef __PRIVREMOVEINSERT_H__
 #define __PRIVREMOVEINSERT_H__
 
+#include "llvm/ADT/DenseSet.h"
 #include "llvm/IR/Instruction.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/Module.h"
@@ -45,6 +46,16 @@ public:
     // Print out information for debugging purposes
     void print(raw_ostream &O, const Module *M) const;
 private:
+    // BBs with priv_remove inserted at the end and at the start
+    DenseSet<BasicBlock *> RemoveAtEnd;
+    DenseSet<BasicBlock *> RemoveAtStart;
+
+    // The number of BBs split by SplitBB and merged back
+    unsigned NumMergedBB;
+
+    // Merge BBs split by SplitBB back if no priv_remove is inserted
+    void mergeSplitBBs(const std::vector<BasicBlock *> &ExtraJMPBB);
+
     // get remove call
     Function *getRemoveFunc(Module &M);
 
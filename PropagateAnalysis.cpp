@@ -7,15 +7,11 @@
 //
 // ====-------------------------------------------------------====
 
-#include "llvm/IR/DerivedTypes.h"
-#include "llvm/Analysis/CallGraph.h"
-
 #include "PropagateAnalysis.h"
 #include "LocalAnalysis.h"
-#include "DSAExternAnalysis.h"
-// #include "dsa/DataStructure.h"
-// #include "dsa/DSGraph.h"
-// #include "dsa/CallTargets.h"
+#include "SplitBB.h"
+#include "PrivCallGraph.h"
+#include "Dataflow.h"
 
 #include <array>
 #include <vector>
@@ -23,11 +19,11 @@
 #include <stack>
 
 using namespace llvm;
-using namespace dsa;
 using namespace llvm::privAnalysis;
 using namespace llvm::localAnalysis;
+using namespace llvm::splitBB;
 using namespace llvm::propagateAnalysis;
-using namespace llvm::dsaexterntarget;
+using namespace llvm::privCallGraph;
 
 // PropagateAnalysis constructor
 PropagateAnalysis::PropagateAnalysis() : ModulePass(ID) { }
@@ -37,9 +33,9 @@ PropagateAnalysis::PropagateAnalysis() : ModulePass(ID) { }
 void PropagateAnalysis::getAnalysisUsage(AnalysisUsage &AU) const
 {
     AU.setPreservesCFG();
+    AU.addRequired<SplitBB>();
     AU.addRequired<LocalAnalysis>();
-    AU.addRequired<DSAExternAnalysis>();
-    // AU.addRequired<CallTargetFinder<TDDataStructures> >();
+    AU.addRequired<PrivCallGraph>();
 
     // preserve usage
     AU.setPreservesAll();
@@ -59,10 +55,8 @@ bool PropagateAnalysis::runOnModule(Module &M)
 {
     LocalAnalysis &LA = getAnalysis<LocalAnalysis>();
 
-    // Get all data structures for propagation analysis
+    // The propagation starts from the local CAPs of functions
     FuncCAPTable = LA.FuncCAPTable;
-    BBCAPTable = LA.BBCAPTable;
-    BBFuncTable = LA.BBFuncTable;
 
     Propagate(M);
 
@@ -70,154 +64,84 @@ bool PropagateAnalysis::runOnModule(Module &M)
 }
 
 
-// Adding dummy function of type void(*)(void)
-// param: M    - the module
-//        name - function name
-Function* PropagateAnalysis::InsertDummyFunc(Module &M, const StringRef name)
-{
-    Type *voidTy = Type::getVoidTy(M.getContext());
-    std::vector<Type *>Params;
-    
-    FunctionType *dummyType = FunctionType::get(voidTy, ArrayRef<Type *>(Params),
-                                                false);
-    Constant *func = M.getOrInsertFunction(name, dummyType);
-    return dyn_cast<Function>(func);
-}
-
-
-// Depth First Search data propagation analysis
+// Data propagation analysis on the condensed call graph
+// The call graph is condensed into SCCs, and the SCCs are propagated
+// bottom-up by the dataflow solver. Only SCCs with cycles are iterated.
 // param: M - the program module
-//        FuncCAPTable - the captable to store live analysis data
 void PropagateAnalysis::Propagate(Module &M)
 {
-    // The ins and outs of function
-    FuncCAPTable_t FuncCAPTable_in;
-    FuncCAPTable_t FuncCAPTable_out;
-    CallGraph CG(M);
-    bool ischanged;
-
-    // Get DSA analysis of callgraph
-    // const CallTargetFinder<TDDataStructures> &DSAFinder 
-    //     = getAnalysis<CallTargetFinder<TDDataStructures> >();
-    const DSAExternAnalysis &DSAFinder = getAnalysis<DSAExternAnalysis>();
-    FunctionMap_t callgraphMap = DSAFinder.callgraphMap;
-    
-    // Add dummy external calls node function as NULL
-    // Add them to function table 
-    CallGraphNode* callsNode = CG.getCallsExternalNode();
-    CallGraphNode* callingNode = CG.getExternalCallingNode();
-    callsNodeFunc = InsertDummyFunc(M, "CallsExternNode");
-    callingNodeFunc = InsertDummyFunc(M, "CallsExternNode");
-    FuncCAPTable[callsNodeFunc] = {};
-    FuncCAPTable[callingNodeFunc] = {};
-
-    // copy keys to FuncCAPTable_in
-    // TODO: Is FuncCAPTable_in really needed here?
-    // TODO: Could be using FuncCAPTable directly?
-    CopyTableKeys(FuncCAPTable_in, FuncCAPTable);
-    CopyTableKeys(FuncCAPTable_out, FuncCAPTable);
-
-    // Keep iterating until converged
-    do {
-        ischanged = false;
-
-        // iterate the whole callgraph 
-        for (CallGraph::iterator NI = CG.begin(), NE = CG.end();
-             NI != NE; ++NI) {
-            // Get CallgraphNode
-            CallGraphNode *N = NI->second;
-            Function *FCaller;
-
-            // special handle external nodes
-            if (N == callingNode)    { FCaller = callingNodeFunc; }
-            else if (N == callsNode) { continue; }
-            else                     { FCaller = N->getFunction(); }
-
-            // Get Caller mapped array in FuncCAPTables
-            CAPArray_t &callerIn = FuncCAPTable_in[FCaller];
-            CAPArray_t &callerOut = FuncCAPTable_out[FCaller];
-
-            // Iterate through Callgraphnode for callees
-            // propagate info from callee to caller
-            for (CallGraphNode::iterator RI = N->begin(), RE = N->end();
-                 RI != RE; ++RI) {
-                CallGraphNode* callee = RI->second;
-                Function* FCallee = callee->getFunction(); 
-
-                if (callee == callingNode) { continue; }
-
-                // special case main function
-                // as no info should propagate from main node
-                if (FCallee == M.getFunction("main")) { continue; }
-
-                // Get callee
-                // If callee is external callsNode, find it in DSA
-                // --------------------------------------------- //
-                // For function calling to external callsNode,
-                // it indicates that it's calling to unresolved
-                // function pointers, and needs info propagated
-                // from external callingNode.
-                // The only exception being when DSA resolves
-                // the function pointers (It's "complete" in DSA
-                // analysis), then it could propagate from only 
-                // the resolved function pointers
-                // --------------------------------------------- //
-                if (callee == callsNode) { 
-                    // Find in DSA. If compelete in DSA, then don't propagate
-                    // from extern callsnode 
-                    if (callgraphMap.find(FCallee) != callgraphMap.end()) {
-                        // propagate from all its callees in DSA analysis
-                        std::vector<Function*>DSAcallees
-                            = callgraphMap[FCallee];
-                        for (std::vector<Function*>::
-                                 iterator CI = DSAcallees.begin(), CE = DSAcallees.end();
-                             CI!= CE; ++CI) {
-                            CAPArray_t &calleeIn = FuncCAPTable_in[*CI];
-                            ischanged |= UnionCAPArrays(callerOut, calleeIn);
-                        }
-                    }
-                    else {
-                        // incomplete in DSA, propagate from extern calls node
-                        CAPArray_t &calleeIn = FuncCAPTable_in[callsNodeFunc];
-                        ischanged |= UnionCAPArrays(callerOut, calleeIn);
-                    }
-                }
-
-                // Propagate all information from callee to caller_out 
-                ischanged |= UnionCAPArrays(callerOut, FuncCAPTable_in[FCallee]);
-            } // Iterate through Callgraphnode for callees
-
-            // Propagate all information from caller_out to caller_in
-            ischanged |= UnionCAPArrays(callerOut, FuncCAPTable[FCaller]);
-            ischanged |= UnionCAPArrays(callerIn, callerOut);
-        } // iterator for caller nodes
-
-        // special handle calls external node, propagate callees of external
-        // calling node to this calls external node
-        CAPArray_t &callingNodeIn = FuncCAPTable_in[callingNodeFunc];
-        CAPArray_t &callsNodeIn = FuncCAPTable_in[callsNodeFunc];
-        CAPArray_t &callsNodeOut = FuncCAPTable_out[callsNodeFunc];
-        
-        ischanged |= UnionCAPArrays(callsNodeOut, callingNodeIn);
-        ischanged |= UnionCAPArrays(callsNodeIn, callsNodeOut);
-
-    } while (ischanged); // main loop
-
-    // Erase dummy function nodes. Restore function-CAPArray table
-    // FuncCAPTable_in.erase(callsNodeFunc);
-    // FuncCAPTable_in.erase(callingNodeFunc);
-
-    FuncCAPTable = FuncCAPTable_in;
+    ModuleNumbering &Numbering = getAnalysis<SplitBB>().Numbering;
+    const PrivCallGraph &CG = getAnalysis<PrivCallGraph>();
+
+    // main function is looked up only once
+    Function *mainFunc = M.getFunction("main");
+    unsigned mainID = mainFunc ? Numbering.getFuncID(mainFunc) : INVALID_ID;
+
+    // The external nodes are numbered by PrivCallGraph
+    FuncCAPTable.resize(Numbering.getNumFuncs(), 0);
+
+    // ---------------------------------------------------------- //
+    // Build the call graph over function IDs, from callers to the
+    // callees they propagate information from. Indirect calls are
+    // resolved by DSA in the shared call graph already. Functions
+    // not in the slice never run, and use no CAPs.
+    // ---------------------------------------------------------- //
+    AdjList_t Callees(Numbering.getNumFuncs());
+
+    for (unsigned FID = 0, FE = CG.Calls.getNumNodes(); FID != FE; ++FID) {
+        if (!CG.isInSlice(FID)) {
+            FuncCAPTable[FID] = CAPArray_t(0);
+            continue;
+        }
+
+        for (const unsigned *CI = CG.Calls.succ_begin(FID),
+                 *CE = CG.Calls.succ_end(FID); CI != CE; ++CI) {
+            // special case main function
+            // as no info should propagate from main node
+            if (*CI == mainID) { continue; }
+
+            Callees[FID].push_back(*CI);
+        }
+    }
+
+    // ---------------------------------------------------------- //
+    // Propagate bottom-up over the SCCs. SCCs are prioritized in
+    // reverse topological order, so callees are always final before
+    // their callers are visited, and only SCCs with cycles are
+    // revisited by the solver.
+    //   in[F] = FuncCAPTable[F] | in[C] for all callees C of F
+    // The table is solved in place as both the gen and the in. The
+    // in of F always contains its gen, so the least fixpoint is the
+    // same as solving into a separate table.
+    // ---------------------------------------------------------- //
+    CSRGraph Calls, Callers;
+    Calls.build(Callees);
+    Callers.buildReverse(Calls);
+
+    std::vector<std::vector<unsigned> > SCCs;
+    FindSCCs(Calls, SCCs);
+
+    std::vector<unsigned> Priority(Numbering.getNumFuncs(), 0);
+    for (unsigned i = 0, e = SCCs.size(); i != e; ++i) {
+        for (auto NI = SCCs[i].begin(), NE = SCCs[i].end(); NI != NE; ++NI) {
+            Priority[*NI] = e - i;
+        }
+    }
+
+    SolveDataflowWithThreads<DATAFLOW_BACKWARD>(Calls, Callers, Priority,
+                                                FuncCAPTable.data(),
+                                                FuncCAPTable.data());
 }
 
 
 // Print out information for debugging purposes
 void PropagateAnalysis::print(raw_ostream &O, const Module *M) const
 {
-    for (auto I = FuncCAPTable.begin(), E = FuncCAPTable.end();
-         I != E; ++I) {
-        Function *F = (*I).first;
-        CAPArray_t A = (*I).second;
+    const ModuleNumbering &Numbering = getAnalysis<SplitBB>().Numbering;
+
+    for (unsigned ID = 0, E = FuncCAPTable.size(); ID != E; ++ID) {
+        Function *F = Numbering.getFunc(ID);
+        CAPArray_t A = FuncCAPTable[ID];
 
         O << F->getName() << ": ";
         dumpCAPArray(O, A);
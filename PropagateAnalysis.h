@@ -14,7 +14,6 @@
 #include "llvm/IR/Function.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Pass.h"
-#include "llvm/Analysis/CallGraph.h"
 #include "llvm/Support/raw_ostream.h"
 
 #include "ADT.h"
@@ -34,19 +33,9 @@ public:
     static char ID;
 
     // CAPTable after info propagation
+    // The BB tables are read from LocalAnalysis and SplitBB
     FuncCAPTable_t FuncCAPTable;
 
-    // Data structure for priv capability use in each BB
-    // Maps from BB to -> Array of Capabilities
-    BBCAPTable_t BBCAPTable;
-
-    // Map from BB to its non-external Function Calls
-    BBFuncTable_t BBFuncTable;
-
-    // Dummy Node of callingNode and callsNode
-    Function* callingNodeFunc;
-    Function* callsNodeFunc;
-
     // constructor
     PropagateAnalysis();
 
@@ -62,9 +51,6 @@ public:
     // Print out information for debugging purposes
     void print(raw_ostream &O, const Module *M) const;
 private:
-    // Insert dummy function
-    static Function *InsertDummyFunc(Module &M, const StringRef name); 
-
     // Data propagation analysis
     void Propagate(Module &M);
 
@@ -6,20 +6,40 @@
 // ====-------------------------------------------------------====
 
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Support/CommandLine.h"
 
 #include "ADT.h"
+#include "ModuleSummary.h"
 #include "SplitBB.h"
 
 #include <linux/capability.h>
+#include <algorithm>
 #include <map>
 #include <array>
 
 using namespace llvm;
 using namespace llvm::splitBB;
 
+#define DEBUG_TYPE "splitbb"
+
+STATISTIC(NumSkippedCallsStat, "Number of call sites not split on");
+
+
+// Split BBs virtually into segments, the IR is not changed
+static cl::opt<bool> VirtualSplit("priv-virtual-split",
+                                  cl::desc("Split BBs into virtual segments "
+                                           "instead of splitting the IR"),
+                                  cl::init(false));
+
+// Split on calls to all functions, including the ones never
+// reaching priv_raise
+static cl::opt<bool> SplitAll("priv-split-all",
+                              cl::desc("Split BBs on calls to all functions"),
+                              cl::init(false));
+
 
 // Constructor
-SplitBB::SplitBB() : ModulePass(ID) {}
+SplitBB::SplitBB() : ModulePass(ID), NumSkippedCalls(0) {}
 
 
 // do Initialization
@@ -32,108 +52,211 @@ bool SplitBB::doInitialization(Module &M)
 // run on Basic Block
 bool SplitBB::runOnModule(Module &M)
 {
-    // Split on PrivRaise calls
-    Function *FRaise = M.getFunction(PRIVRAISE);
-    if (FRaise != NULL) {
-        splitOnFunction(FRaise, SPLIT_HERE);
-    }
+    // Walk the module once for the summaries of all functions
+    SummarizeModule(M, Numbering, Summary);
 
-    // Split on PrivLower calls
-    Function *FLower = M.getFunction(PRIVLOWER);
-    if (FLower != NULL) {
-        splitOnFunction(FLower, SPLIT_NEXT);
+    if (!SplitAll) {
+        findRelevantFuncs(M);
     }
 
-    // Split on non-extern Function call sites
-    for (Module::iterator FI = M.begin(), FE = M.end();
-         FI != FE; ++ FI) {
-        Function *F = dyn_cast<Function>(FI);
+    // Partition all BBs on priv_* calls and function call sites.
+    // Direct calls of each function are in the order of BBs, and
+    // the calls of a BB are collected before the BB is split.
+    std::vector<CallInst *> BBCalls;
+    for (auto SI = Summary.begin(), SE = Summary.end(); SI != SE; ++SI) {
+        const std::vector<CallInst *> &Calls = SI->DirectCalls;
 
-        // skip priv_* calls
-        if (F->getName() == PRIVRAISE ||
-            F->getName() == PRIVLOWER){
-            continue;
+        for (auto CI = Calls.begin(), CE = Calls.end(); CI != CE; ) {
+            BasicBlock *BB = (*CI)->getParent();
+
+            BBCalls.clear();
+            for (; CI != CE && (*CI)->getParent() == BB; ++CI) {
+                BBCalls.push_back(*CI);
+            }
+
+            partitionBB(BB, BBCalls);
         }
+    }
 
-        // skip external functions
-        // if (F->empty()){
-        // continue;
-        // }
+    // Number all BBs now that BBs are final,
+    // and fill the BBFuncTable with the numbering
+    Numbering.numberModule(M);
+    BBFuncTable.assign(Numbering.getNumBBs(), NULL);
 
-        splitOnFunction(F, SPLIT_HERE | SPLIT_NEXT);
+    for (auto CI = CallSiteInst.begin(), CE = CallSiteInst.end(); CI != CE; ++CI) {
+        BBFuncTable[Numbering.getSegmentID(*CI)] = (*CI)->getCalledFunction();
     }
 
-    return true;
+    for (auto CI = UnsplitCallInst.begin(), CE = UnsplitCallInst.end();
+         CI != CE; ++CI) {
+        UnsplitCalls.push_back(std::make_pair(
+            Numbering.getSegmentID(*CI),
+            Numbering.getFuncID((*CI)->getCalledFunction())));
+    }
+    std::sort(UnsplitCalls.begin(), UnsplitCalls.end());
+
+    NumSkippedCallsStat += NumSkippedCalls;
+
+    // Only modified the IR if BBs are physically split
+    return !VirtualSplit;
 }
 
 
-// split on all calling site of the Function
-// param: F - The function to split
-//        splitLoc - SPLIT_HERE split on the instruction
-//                   SPLIT_NEXT split on the next instruction
-//                   SPLIT_HERE | SPLIT_NEXT split both locations
-void SplitBB::splitOnFunction(Function *F, int splitLoc)
+// Find all functions which can reach priv_raise, an indirect call or
+// a declaration, by propagating from them to their callers on the
+// direct call graph. A declaration may call back into the module, as
+// qsort or pthread_create do, so it is kept as a call site for the
+// CAPs of the extern nodes. Calls to the other functions, including
+// intrinsics, never raise any capability, so BBs are not split on them
+// param: M - the module
+void SplitBB::findRelevantFuncs(Module &M)
 {
-    // Iterate all uses for calling instruction
-    for (Value::user_iterator UI = F->user_begin(), UE = F->user_end();
-         UI != UE; ++ UI) {
-        CallInst *CI = dyn_cast<CallInst>(*UI);
-        if (CI == NULL || CI->getCalledFunction() != F) {
+    unsigned NumFuncs = Summary.size();
+    AdjList_t Callers(NumFuncs);
+    std::vector<unsigned> Worklist;
+
+    RelevantFuncs.assign(NumFuncs, false);
+
+    Function *RaiseFunc = M.getFunction(PRIVRAISE);
+    if (RaiseFunc != NULL) {
+        RelevantFuncs[Numbering.getFuncID(RaiseFunc)] = true;
+        Worklist.push_back(Numbering.getFuncID(RaiseFunc));
+    }
+
+    for (unsigned FID = 0; FID != NumFuncs; ++FID) {
+        const std::vector<unsigned> &Callees = Summary[FID].Callees;
+        for (auto CI = Callees.begin(), CE = Callees.end(); CI != CE; ++CI) {
+            Callers[*CI].push_back(FID);
+        }
+
+        // A declaration other than intrinsics and priv_lower
+        Function *F = Numbering.getFunc(FID);
+        if (F->empty() && !F->isIntrinsic() && F->getName() != PRIVLOWER &&
+            !RelevantFuncs[FID]) {
+            RelevantFuncs[FID] = true;
+            Worklist.push_back(FID);
             continue;
         }
-      
-        // If split on the head of the calling instruction
-        if (splitLoc & SPLIT_HERE){
-            BasicBlock *BB = CI->getParent();
-
-            if (dyn_cast<Instruction>(CI) !=
-                dyn_cast<Instruction>(BB->begin())) {
-
-                // Split on the instruction
-                // Old BB now has an extra jmp as terminator,
-                // save Old BB for later counting
-                BasicBlock *NewBB = BB->splitBasicBlock(CI);
-
-                ExtraJMPBB.push_back(BB);
-
-                // Save to data structure for later use
-                // If instruction is priv_raise, save to PrivBB
-                // Else if a function call, save to CallSiteBB and BBFuncTable
-                if (F->getName() == PRIVRAISE) {
-                    PrivBB.push_back(NewBB);
-                }
-                else {
-                    CallSiteBB.push_back(NewBB);
-                    BBFuncTable[NewBB] = F;
-                }
+
+        if (!Summary[FID].IndirectCalls.empty() && !RelevantFuncs[FID]) {
+            RelevantFuncs[FID] = true;
+            Worklist.push_back(FID);
+        }
+    }
+
+    while (!Worklist.empty()) {
+        unsigned FID = Worklist.back();
+        Worklist.pop_back();
+
+        for (auto CI = Callers[FID].begin(), CE = Callers[FID].end();
+             CI != CE; ++CI) {
+            if (!RelevantFuncs[*CI]) {
+                RelevantFuncs[*CI] = true;
+                Worklist.push_back(*CI);
             }
-            else {
-                // else, push the original BB to data structure
-                if (F->getName() == PRIVRAISE) {
-                    PrivBB.push_back(BB);
-                }
-                else {
-                    CallSiteBB.push_back(BB);
-                    BBFuncTable[BB] = F;
-                }
+        }
+    }
+}
+
+
+// get the split location of calls to the function
+// param: F - the called function
+// return: SPLIT_HERE split on the instruction
+//         SPLIT_NEXT split on the next instruction
+//         SPLIT_HERE | SPLIT_NEXT split both locations
+int SplitBB::getSplitLoc(Function *F)
+{
+    if (F->getName() == PRIVRAISE) { return SPLIT_HERE; }
+    if (F->getName() == PRIVLOWER) { return SPLIT_NEXT; }
+
+    return SPLIT_HERE | SPLIT_NEXT;
+}
+
+
+// Partition the BB on all its priv_* calls and function calls
+// The cut points are collected in one sweep, and the BB is split
+// from the last cut point, so each instruction is moved only once.
+// With -priv-virtual-split, the cut points are only added to the
+// numbering as segments, and the BB is not changed.
+// param: BB - the BB to partition
+//        Calls - the direct calls in the BB, in order
+void SplitBB::partitionBB(BasicBlock *BB, const std::vector<CallInst *> &Calls)
+{
+    std::vector<Instruction *> Cuts;
+    std::vector<CallInst *> RaiseCalls;
+    std::vector<CallInst *> FuncCalls;
+
+    for (auto II = Calls.begin(), IE = Calls.end(); II != IE; ++II) {
+        CallInst *CI = *II;
+        Function *F = CI->getCalledFunction();
+
+        // Skip calls never reaching priv_raise, a defined callee is
+        // still saved to return to the BB of the call
+        if (!SplitAll && F->getName() != PRIVLOWER &&
+            !RelevantFuncs[Numbering.getFuncID(F)]) {
+            if (!F->empty()) {
+                UnsplitCallInst.push_back(CI);
             }
+            ++NumSkippedCalls;
+            continue;
         }
 
-        // If split on next of the calling instruction
-        if (splitLoc & SPLIT_NEXT) {
-            BasicBlock *BB = CI->getParent();
+        int splitLoc = getSplitLoc(F);
 
-            if (dyn_cast<Instruction>(CI) !=
-                dyn_cast<Instruction>(BB->end())) {
+        // If instruction is priv_raise, save to PrivBB
+        // Else if a function call, save to CallSiteBB and BBFuncTable
+        if (F->getName() == PRIVRAISE) {
+            RaiseCalls.push_back(CI);
+        }
+        else if (F->getName() != PRIVLOWER) {
+            FuncCalls.push_back(CI);
+        }
 
-                BB->splitBasicBlock(CI->getNextNode());
+        // Split on the head of the calling instruction, unless it's
+        // the head of the BB or already split after the last call
+        if ((splitLoc & SPLIT_HERE) && CI != &BB->front() &&
+            (Cuts.empty() || Cuts.back() != CI)) {
+            Cuts.push_back(CI);
+        }
 
-                ExtraJMPBB.push_back(BB);
+        // Split on next of the calling instruction
+        if (splitLoc & SPLIT_NEXT) {
+            Cuts.push_back(CI->getNextNode());
+        }
+    }
+
+    if (VirtualSplit) {
+        // A terminator is kept in the segment before it, as it may be
+        // replaced later by transformations
+        for (auto CI = Cuts.begin(), CE = Cuts.end(); CI != CE; ++CI) {
+            if (!(*CI)->isTerminator()) {
+                Numbering.addCut(*CI);
             }
         }
+    }
+    else if (!Cuts.empty()) {
+        for (auto CI = Cuts.rbegin(), CE = Cuts.rend(); CI != CE; ++CI) {
+            BB->splitBasicBlock(*CI);
+        }
 
-    } // iterate all uses for calling instructions
-} // split on function
+        // All BBs except the last one now have an extra jmp as terminator,
+        // save them for later counting
+        ExtraJMPBB.push_back(BB);
+        for (unsigned i = 0, e = Cuts.size() - 1; i != e; ++i) {
+            ExtraJMPBB.push_back(Cuts[i]->getParent());
+        }
+    }
+
+    // Save to data structure for later use
+    for (auto CI = RaiseCalls.begin(), CE = RaiseCalls.end(); CI != CE; ++CI) {
+        PrivBB.push_back((*CI)->getParent());
+    }
+
+    for (auto CI = FuncCalls.begin(), CE = FuncCalls.end(); CI != CE; ++CI) {
+        CallSiteBB.push_back((*CI)->getParent());
+        CallSiteInst.push_back(*CI);
+    }
+}
 
 
 void SplitBB::print(raw_ostream &O, const Module *M) const
@@ -143,6 +266,8 @@ void SplitBB::print(raw_ostream &O, const Module *M) const
     errs() << "Priv BB size: " << PrivBB.size() << "\n";
 
     errs() << "CallSite BB size: " << CallSiteBB.size() << "\n";
+
+    errs() << "Skipped call sites: " << NumSkippedCalls << "\n";
 }
 
 
@@ -19,6 +19,7 @@
 #include <vector>
 
 #include "ADT.h"
+#include "ModuleSummary.h"
 
 #define SPLIT_HERE  1
 #define SPLIT_NEXT  2
@@ -37,6 +38,7 @@ public:
     SplitBB();
 
     // Vector to store BB info for analysis
+    // With virtual split, these are the original BBs with segments
     std::vector<BasicBlock *> PrivBB;
 
     // Vector to store BB info for analysis
@@ -48,6 +50,21 @@ public:
     // Map from BB to its non-external Function Calls
     BBFuncTable_t BBFuncTable;
 
+    // Calls to defined functions not reaching priv_raise, which are
+    // not split on. Their BBs still return from the callees.
+    BBCallList_t UnsplitCalls;
+
+    // The number of call sites not split on
+    unsigned NumSkippedCalls;
+
+    // Dense numbering of Functions and BBs (or virtual segments)
+    // after splitting, shared by all later analysis passes
+    ModuleNumbering Numbering;
+
+    // Summaries of all functions from one walk of the module,
+    // indexed by function IDs and shared by all later passes
+    ModuleSummary_t Summary;
+
     // initialization
     virtual bool doInitialization(Module &M);
 
@@ -59,8 +76,25 @@ public:
 
     void print(raw_ostream &O, const Module *M) const;
 private:
-    // Split instruction on all the Function calling sites
-    void splitOnFunction(Function *F, int splitLoc);
+    // Call instructions of BBs in CallSiteBB, saved before BBs are numbered
+    std::vector<CallInst *> CallSiteInst;
+
+    // Calls saved to UnsplitCalls after BBs are numbered
+    std::vector<CallInst *> UnsplitCallInst;
+
+    // If each function ID reaches priv_raise, an indirect call
+    // or a declaration
+    std::vector<bool> RelevantFuncs;
+
+    // Find all functions reaching priv_raise, an indirect call
+    // or a declaration
+    void findRelevantFuncs(Module &M);
+
+    // Get the split location of calls to the function
+    static int getSplitLoc(Function *F);
+
+    // Partition the BB on all priv_* calls and function calls
+    void partitionBB(BasicBlock *BB, const std::vector<CallInst *> &Calls);
 
 }; // struct splitBB
 
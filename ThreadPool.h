@@ -0,0 +1,128 @@
+// ====-------------------  ThreadPool.h --------*- C++ -*---====
+//
+// A work stealing thread pool running the tasks of a DAG. A task
+// is ready to run after all the tasks it depends on are done, so
+// results of a task are only read by other tasks after they are
+// final.
+//
+// ====-------------------------------------------------------====
+
+#ifndef __THREADPOOL_H__
+#define __THREADPOOL_H__
+
+#include "ADT.h"
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace llvm {
+namespace privAnalysis {
+
+// The task queue of each thread. The owner pushes and pops at the
+// back, other threads steal from the front.
+struct WorkQueue
+{
+public:
+    void push(unsigned Task)
+    {
+        std::lock_guard<std::mutex> Lock(Mutex);
+        Tasks.push_back(Task);
+    }
+
+    bool pop(unsigned &Task)
+    {
+        std::lock_guard<std::mutex> Lock(Mutex);
+        if (Tasks.empty()) { return false; }
+        Task = Tasks.back();
+        Tasks.pop_back();
+        return true;
+    }
+
+    bool steal(unsigned &Task)
+    {
+        std::lock_guard<std::mutex> Lock(Mutex);
+        if (Tasks.empty()) { return false; }
+        Task = Tasks.front();
+        Tasks.pop_front();
+        return true;
+    }
+
+private:
+    std::mutex Mutex;
+    std::deque<unsigned> Tasks;
+};
+
+
+// Run all tasks of a DAG on a work stealing thread pool
+// param: Users - for each task, the tasks depending on it
+//        NumDeps - the number of tasks each task depends on,
+//                  counting each edge in Users once
+//        Run - the function to run a task, called as Run(Task)
+//        NumThreads - the number of threads, including the caller
+template <typename RunT>
+void RunDAGTasks(const CSRGraph &Users, const std::vector<unsigned> &NumDeps,
+                 RunT Run, unsigned NumThreads)
+{
+    unsigned NumTasks = Users.getNumNodes();
+    std::unique_ptr<std::atomic<unsigned>[]>
+        Pending(new std::atomic<unsigned>[NumTasks]);
+    std::vector<WorkQueue> Queues(NumThreads);
+    std::atomic<unsigned> Remaining(NumTasks);
+
+    // seed the ready tasks to all threads
+    unsigned Next = 0;
+    for (unsigned Task = 0; Task != NumTasks; ++Task) {
+        Pending[Task].store(NumDeps[Task], std::memory_order_relaxed);
+        if (NumDeps[Task] == 0) {
+            Queues[Next++ % NumThreads].push(Task);
+        }
+    }
+
+    auto Worker = [&](unsigned Self) {
+        while (Remaining.load(std::memory_order_acquire) != 0) {
+            unsigned Task;
+            bool Found = Queues[Self].pop(Task);
+
+            for (unsigned i = 1; !Found && i != NumThreads; ++i) {
+                Found = Queues[(Self + i) % NumThreads].steal(Task);
+            }
+
+            if (!Found) {
+                std::this_thread::yield();
+                continue;
+            }
+
+            Run(Task);
+
+            // the last finished dependency makes a user ready
+            for (const unsigned *UI = Users.succ_begin(Task),
+                     *UE = Users.succ_end(Task); UI != UE; ++UI) {
+                if (Pending[*UI].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                    Queues[Self].push(*UI);
+                }
+            }
+
+            Remaining.fetch_sub(1, std::memory_order_release);
+        }
+    };
+
+    std::vector<std::thread> Threads;
+    for (unsigned i = 1; i < NumThreads; ++i) {
+        Threads.push_back(std::thread(Worker, i));
+    }
+
+    Worker(0);
+
+    for (auto TI = Threads.begin(), TE = Threads.end(); TI != TE; ++TI) {
+        TI->join();
+    }
+}
+
+} // namespace privAnalysis
+} // namespace llvm
+
+#endif
@@ -0,0 +1,228 @@
+// ====---------------  TypeCallResolver.cpp ------*- C++ -*---====
+//
+// Fast resolution of indirect call targets without DSA. The callees
+// of an indirect call are the functions found by the points-to step,
+// and the call is incomplete if any source of the pointer is unknown.
+//
+// ====-------------------------------------------------------====
+
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Operator.h"
+
+#include "TypeCallResolver.h"
+
+#include <algorithm>
+
+
+namespace llvm {
+namespace privAnalysis {
+
+// Collect the functions in the initializer of a global
+// param: C - the constant
+//        Pointees - the functions to save to
+static void collectConstantFuncs(Constant *C, std::vector<Function *> &Pointees)
+{
+    C = C->stripPointerCasts();
+
+    if (Function *F = dyn_cast<Function>(C)) {
+        Pointees.push_back(F);
+        return;
+    }
+
+    if (isa<ConstantArray>(C) || isa<ConstantStruct>(C) || isa<ConstantVector>(C)) {
+        for (unsigned i = 0, e = C->getNumOperands(); i != e; ++i) {
+            collectConstantFuncs(cast<Constant>(C->getOperand(i)), Pointees);
+        }
+    }
+}
+
+
+// Strip GEPs and casts from a pointer to find the object it's in
+static Value *getBaseObject(Value *Ptr)
+{
+    while (true) {
+        Ptr = Ptr->stripPointerCasts();
+        if (GEPOperator *GEP = dyn_cast<GEPOperator>(Ptr)) {
+            Ptr = GEP->getPointerOperand();
+            continue;
+        }
+        return Ptr;
+    }
+}
+
+
+// Constructor
+TypeCallResolver::TypeCallResolver(bool UsePointsTo)
+    : UsePointsTo(UsePointsTo)
+{
+}
+
+
+// Find the possible callees of an indirect call
+// The callees are only complete if the points-to step proves every
+// source of the called pointer. The type signature alone is never
+// complete, as the pointer may be cast from a function of another
+// type, or come from outside the module, e.g. from dlsym.
+// param: CS - the indirect call site
+//        Targets - the callees to save to
+// return: if the callees are complete, i.e. there is a callee
+bool TypeCallResolver::findTargets(CallSite CS, std::vector<Function *> &Targets)
+{
+    Targets.clear();
+    if (!UsePointsTo) { return false; }
+
+    SmallPtrSet<Value *, 16> Visited;
+    if (!tracePointees(CS.getCalledValue(), Visited, Targets)) {
+        Targets.clear();
+        return false;
+    }
+
+    std::sort(Targets.begin(), Targets.end());
+    Targets.erase(std::unique(Targets.begin(), Targets.end()), Targets.end());
+    return !Targets.empty();
+}
+
+
+// Trace the functions a pointer may point to, flow-insensitively
+// param: V - the pointer
+//        Visited - the values traced already
+//        Pointees - the functions to save to
+// return: false if the pointer may point to unknown functions
+bool TypeCallResolver::tracePointees(Value *V, SmallPtrSet<Value *, 16> &Visited,
+                                     std::vector<Function *> &Pointees)
+{
+    V = V->stripPointerCasts();
+    if (!Visited.insert(V).second) { return true; }
+
+    if (Function *F = dyn_cast<Function>(V)) {
+        Pointees.push_back(F);
+        return true;
+    }
+
+    if (isa<ConstantPointerNull>(V) || isa<UndefValue>(V)) {
+        return true;
+    }
+
+    if (PHINode *PN = dyn_cast<PHINode>(V)) {
+        for (unsigned i = 0, e = PN->getNumIncomingValues(); i != e; ++i) {
+            if (!tracePointees(PN->getIncomingValue(i), Visited, Pointees)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    if (SelectInst *SI = dyn_cast<SelectInst>(V)) {
+        return tracePointees(SI->getTrueValue(), Visited, Pointees) &&
+            tracePointees(SI->getFalseValue(), Visited, Pointees);
+    }
+
+    // A load from an internal global, field-insensitively
+    if (LoadInst *LI = dyn_cast<LoadInst>(V)) {
+        GlobalVariable *G = dyn_cast<GlobalVariable>(getBaseObject(LI->getPointerOperand()));
+        if (G == NULL) { return false; }
+
+        const GlobalPointees &GP = traceGlobal(G);
+        if (!GP.Known) { return false; }
+
+        Pointees.insert(Pointees.end(), GP.Funcs.begin(), GP.Funcs.end());
+        return true;
+    }
+
+    // An argument of an internal function only called directly
+    if (Argument *A = dyn_cast<Argument>(V)) {
+        Function *F = A->getParent();
+        if (!F->hasLocalLinkage() || F->hasAddressTaken()) { return false; }
+
+        for (auto UI = F->user_begin(), UE = F->user_end(); UI != UE; ++UI) {
+            CallSite CS(*UI);
+            if (!CS || CS.getCalledValue() != F) { return false; }
+
+            if (!tracePointees(CS.getArgument(A->getArgNo()), Visited, Pointees)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    return false;
+}
+
+
+// Find the functions stored in an internal global, memoized
+// The global is unknown if it's visible outside or its address
+// escapes, e.g. it's stored to memory or passed to a call.
+// param: G - the global
+// return: the functions in the global
+const TypeCallResolver::GlobalPointees &TypeCallResolver::traceGlobal(GlobalVariable *G)
+{
+    auto GI = Globals.find(G);
+    if (GI != Globals.end()) { return GI->second; }
+
+    // Unknown while tracing, so globals storing to each other in a
+    // cycle are conservatively unknown
+    Globals[G].Known = false;
+
+    GlobalPointees GP;
+    GP.Known = G->hasLocalLinkage();
+
+    if (GP.Known && G->hasInitializer()) {
+        collectConstantFuncs(G->getInitializer(), GP.Funcs);
+    }
+
+    if (GP.Known) {
+        SmallPtrSet<Value *, 16> Visited;
+        GP.Known = traceGlobalUses(G, Visited, GP.Funcs);
+    }
+
+    if (!GP.Known) { GP.Funcs.clear(); }
+
+    GlobalPointees &Result = Globals[G];
+    Result = GP;
+    return Result;
+}
+
+
+// Find the functions stored through all uses of a pointer into a global
+// param: Ptr - the pointer
+//        Visited - the values traced already
+//        Pointees - the functions to save to
+// return: false if the address escapes
+bool TypeCallResolver::traceGlobalUses(Value *Ptr, SmallPtrSet<Value *, 16> &Visited,
+                                       std::vector<Function *> &Pointees)
+{
+    for (auto UI = Ptr->user_begin(), UE = Ptr->user_end(); UI != UE; ++UI) {
+        User *U = *UI;
+
+        if (isa<LoadInst>(U)) { continue; }
+
+        if (StoreInst *SI = dyn_cast<StoreInst>(U)) {
+            // storing the address itself escapes it
+            if (SI->getValueOperand() == Ptr) { return false; }
+
+            SmallPtrSet<Value *, 16> StoreVisited;
+            if (!tracePointees(SI->getValueOperand(), StoreVisited, Pointees)) {
+                return false;
+            }
+            continue;
+        }
+
+        // pointers derived from the address
+        if (isa<GEPOperator>(U) || isa<BitCastOperator>(U)) {
+            if (Visited.insert(U).second &&
+                !traceGlobalUses(U, Visited, Pointees)) {
+                return false;
+            }
+            continue;
+        }
+
+        return false;
+    }
+
+    return true;
+}
+
+} // namespace privAnalysis
+} // namespace llvm
@@ -0,0 +1,63 @@
+// ====---------------  TypeCallResolver.h --------*- C++ -*---====
+//
+// Fast resolution of indirect call targets without DSA. Optionally,
+// a flow-insensitive points-to step traces the called pointer through
+// SSA values, internal globals and the arguments of internal
+// functions. A call is only complete if every source of the pointer
+// is traced, otherwise it's left to the extern node, like calls DSA
+// finds incomplete. Without the points-to step no call is complete.
+//
+// ====-------------------------------------------------------====
+
+#ifndef __TYPECALLRESOLVER_H__
+#define __TYPECALLRESOLVER_H__
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/IR/CallSite.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Module.h"
+
+#include <vector>
+
+namespace llvm {
+namespace privAnalysis {
+
+class TypeCallResolver
+{
+public:
+    // param: UsePointsTo - if the points-to step runs
+    TypeCallResolver(bool UsePointsTo);
+
+    // Find the possible callees of an indirect call
+    // param: CS - the indirect call site
+    //        Targets - the callees to save to
+    // return: if the callees are complete
+    bool findTargets(CallSite CS, std::vector<Function *> &Targets);
+
+private:
+    // Functions stored in each internal global, or unknown
+    struct GlobalPointees {
+        bool Known;
+        std::vector<Function *> Funcs;
+    };
+    DenseMap<GlobalVariable *, GlobalPointees> Globals;
+
+    bool UsePointsTo;
+
+    // Trace the functions a pointer may point to
+    bool tracePointees(Value *V, SmallPtrSet<Value *, 16> &Visited,
+                       std::vector<Function *> &Pointees);
+
+    // Find the functions stored in an internal global
+    const GlobalPointees &traceGlobal(GlobalVariable *G);
+
+    // Find the functions stored through all uses of a global
+    bool traceGlobalUses(Value *Ptr, SmallPtrSet<Value *, 16> &Visited,
+                         std::vector<Function *> &Pointees);
+};
+
+} // namespace privAnalysis
+} // namespace llvm
+
+#endif